@@ -296,6 +296,12 @@ command.add(nil, {
     add_project_directory(false)
   end,
 
+  ["core:benchmark-rects"] = renderer.benchmark_rects and function()
+    for _, t in ipairs(renderer.benchmark_rects(core.window, 200)) do
+      core.log_quiet("%dx%d translucent rect: fill %.1fus, blit %.1fus", t.width, t.height, t.fill, t.blit)
+    end
+  end or nil,
+
   ["core:remove-directory"] = function()
     local dir_list = {}
     local n = #core.projects
@@ -48,10 +48,11 @@ local function save(filename)
       { text = "No", default_no = true }
     }, function(item)
       if item.text == "Yes" then
-        core.add_thread(function()
+        local thread = core.add_thread(function()
           -- we need to run this in a thread because of the odd way the nagview is.
           command.perform("doc:save-as")
         end)
+        core.set_thread_priority(thread, "input")
       end
     end)
   end
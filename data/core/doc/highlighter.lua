@@ -107,7 +107,11 @@ function Highlighter:tokenize_line(idx, state, resume)
     local res = {}
     res.init_state = state
     res.text = self.doc.buffer:get_line(idx)
-    res.tokens, res.state, res.resume = tokenizer.tokenize(self.doc.syntax, res.text, state, resume)
+    local tokens
+    tokens, res.state, res.resume = tokenizer.tokenize(self.doc.syntax, res.text, state, resume)
+    -- store `{ type_id, length, ... }` pairs, the token text is a slice of
+    -- `res.text`; `res.resume` keeps the raw token list to continue from
+    res.tokens = tokenizer.pack_tokens(tokens)
     return res
 end
 
@@ -125,7 +129,8 @@ function Highlighter:get_line(idx)
 end
 
 function Highlighter:each_token(idx)
-    return tokenizer.each_token(self:get_line(idx).tokens)
+    local line = self:get_line(idx)
+    return tokenizer.each_packed_token(line.tokens, line.text)
 end
 
 return Highlighter
@@ -4,8 +4,10 @@ local config = require "core.config"
 local style = require "core.style"
 local keymap = require "core.keymap"
 local translate = require "core.doc.translate"
+local tokenizer = require "core.tokenizer"
 local ime = require "core.ime"
 local View = require "core.view"
+local view_native = require "view"
 local ContextMenu = require "core.contextmenu"
 
 ---@class core.docview : core.view
@@ -59,6 +61,8 @@ DocView.translate = {
 
 function DocView:new(doc)
   DocView.super.new(self)
+  -- native side used to draw the highlighted lines
+  self.native = view_native.new_doc_view()
   self.cursor = "ibeam"
   self.scrollable = true
   self.doc = assert(doc)
@@ -69,6 +73,8 @@ function DocView:new(doc)
   self.hovering_gutter = false
   self.v_scrollbar:set_forced_status(config.force_scrollbar_status)
   self.h_scrollbar:set_forced_status(config.force_scrollbar_status)
+  -- rasterize the glyphs of the start of the file ahead of the first draws
+  self:get_font():prewarm(doc:get_text(1, 1, 200, math.huge))
 end
 
 
@@ -171,65 +177,24 @@ end
 
 
 function DocView:get_col_x_offset(line, col)
-  local default_font = self:get_font()
-  local _, indent_size = self.doc:get_indent_info()
-  default_font:set_tab_size(indent_size)
-  local column = 1
-  local xoffset = 0
-  for _, type, text in self.doc.highlighter:each_token(line) do
-    local font = style.syntax_fonts[type] or default_font
-    if font ~= default_font then font:set_tab_size(indent_size) end
-    local length = #text
-    if column + length <= col then
-      xoffset = xoffset + font:get_width(text, {tab_offset = xoffset})
-      column = column + length
-      if column >= col then
-        return xoffset
-      end
-    else
-      for char in common.utf8_chars(text) do
-        if column >= col then
-          return xoffset
-        end
-        xoffset = xoffset + font:get_width(char, {tab_offset = xoffset})
-        column = column + #char
-      end
-    end
+  local hl = self.doc.highlighter:get_line(line)
+  if self.palette_size ~= tokenizer.get_type_count() then
+    self:update_syntax_palette()
   end
-
-  return xoffset
+  local _, indent_size = self.doc:get_indent_info()
+  -- binary search in a per-line table of glyph advances, built natively on
+  -- first use and stored in the highlighter line until it changes
+  return self.native:get_col_x_offset(self.doc.buffer, hl, line, col, indent_size)
 end
 
 
 function DocView:get_x_offset_col(line, x)
-  local line_text = self.doc.buffer:get_line(line)
-
-  local xoffset, i = 0, 1
-  local default_font = self:get_font()
-  local _, indent_size = self.doc:get_indent_info()
-  default_font:set_tab_size(indent_size)
-  for _, type, text in self.doc.highlighter:each_token(line) do
-    local font = style.syntax_fonts[type] or default_font
-    if font ~= default_font then font:set_tab_size(indent_size) end
-    local width = font:get_width(text, {tab_offset = xoffset})
-    -- Don't take the shortcut if the width matches x,
-    -- because we need last_i which should be calculated using utf-8.
-    if xoffset + width < x then
-      xoffset = xoffset + width
-      i = i + #text
-    else
-      for char in common.utf8_chars(text) do
-        local w = font:get_width(char, {tab_offset = xoffset})
-        if xoffset + w >= x then
-          return (x <= xoffset + (w / 2)) and i or i + #char
-        end
-        xoffset = xoffset + w
-        i = i + #char
-      end
-    end
+  local hl = self.doc.highlighter:get_line(line)
+  if self.palette_size ~= tokenizer.get_type_count() then
+    self:update_syntax_palette()
   end
-
-  return #line_text
+  local _, indent_size = self.doc:get_indent_info()
+  return self.native:get_x_offset_col(self.doc.buffer, hl, line, x, indent_size)
 end
 
 
@@ -454,25 +419,29 @@ function DocView:draw_line_highlight(x, y)
 end
 
 
+---Rebuild the token type id -> color/font arrays from `style.syntax` and
+---`style.syntax_fonts`, used by `DocView:draw_line_text`.
+function DocView:update_syntax_palette()
+  self.palette_colors = tokenizer.map_types(style.syntax, self.palette_colors)
+  self.palette_fonts = tokenizer.map_types(style.syntax_fonts, self.palette_fonts)
+  self.palette_size = tokenizer.get_type_count()
+  self.native:set_palette(self.palette_colors, self.palette_fonts, self.palette_size, self:get_font())
+end
+
+
 function DocView:draw_line_text(line, x, y)
-  local default_font = self:get_font()
-  local tx, ty = x, y + self:get_line_text_y_offset()
-  local last_token = nil
-  local tokens = self.doc.highlighter:get_line(line).tokens
-  local tokens_count = #tokens
-  if string.sub(tokens[tokens_count], -1) == "\n" then
-    last_token = tokens_count - 1
-  end
-  local start_tx = tx
-  for tidx, type, text in self.doc.highlighter:each_token(line) do
-    local color = style.syntax[type]
-    local font = style.syntax_fonts[type] or default_font
-    -- do not render newline, fixes issue #1164
-    if tidx == last_token then text = text:sub(1, -2) end
-    tx = renderer.draw_text(font, text, tx, ty, color, {tab_offset = tx - start_tx})
-    if tx > self.position.x + self.size.x then break end
+  local highlighter = self.doc.highlighter
+  -- make sure the line is tokenized; this may register new token types
+  highlighter:get_line(line)
+  if self.palette_size ~= tokenizer.get_type_count() then
+    self:update_syntax_palette()
   end
-  return self:get_line_height()
+  -- the tokens and the line text are read natively and pushed to the
+  -- render cache as a single command
+  local lh = self:get_line_height()
+  self.native:draw_lines(self.doc.buffer, highlighter.lines, line, line,
+    x, y + self:get_line_text_y_offset(), lh)
+  return lh
 end
 
 
@@ -594,8 +563,26 @@ function DocView:draw_overlay()
   end
 end
 
+---Tell the renderer how far the content moved since the last draw, so that
+---the lines already drawn are moved instead of drawn again.
+function DocView:hint_scroll()
+  local pos, size = self.position, self.size
+  local _, oy = self:get_content_offset()
+  local last = self.last_scroll_hint
+  if not last then
+    last = {}
+    self.last_scroll_hint = last
+  elseif oy ~= last.offset and pos.x == last.x and pos.y == last.y
+  and size.x == last.w and size.y == last.h then
+    renderer.scroll_rect(pos.x, pos.y, size.x, size.y, oy - last.offset)
+  end
+  last.x, last.y, last.w, last.h, last.offset = pos.x, pos.y, size.x, size.y, oy
+end
+
 function DocView:draw()
+  self:hint_scroll()
   self:draw_background(style.background)
+  self:update_syntax_palette()
   local _, indent_size = self.doc:get_indent_info()
   self:get_font():set_tab_size(indent_size)
 
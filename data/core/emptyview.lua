@@ -9,6 +9,13 @@ local EmptyView = View:extend()
 
 function EmptyView:__tostring() return "EmptyView" end
 
+function EmptyView:new()
+  EmptyView.super.new(self)
+  -- nothing changes while the view is idle, replay what was drawn
+  self:set_retained(true)
+  self.drawn_with = {}
+end
+
 function EmptyView:get_name()
   return "Get Started"
 end
@@ -24,6 +31,26 @@ EmptyView.commands = {
   { fmt = "%s to open a project folder", cmd = "core:open-project-folder" },
 }
 
+function EmptyView:update()
+  EmptyView.super.update(self)
+  -- draw again when the style or the key bindings shown have changed
+  local drawn_with, n = self.drawn_with, 0
+  local function check(value)
+    n = n + 1
+    if drawn_with[n] ~= value then
+      drawn_with[n] = value
+      self:invalidate()
+    end
+  end
+  check(style.background)
+  check(style.dim)
+  check(style.font)
+  check(style.big_font)
+  for _, command in ipairs(self.commands) do
+    check(keymap.get_binding(command.cmd) or false)
+  end
+end
+
 function EmptyView:draw()
   self:draw_background(style.background)
   -- x,y center-point
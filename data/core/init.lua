@@ -2,6 +2,8 @@ require "core.strict"
 require "core.regex"
 local common = require "core.common"
 local config = require "core.config"
+-- must be set before the default fonts are loaded
+renderer.set_glyph_cache_dir(USERDIR .. PATHSEP .. "glyphs")
 local style = require "colors.default"
 local command
 local keymap
@@ -479,6 +481,7 @@ function core.exit(quit_fn, force)
     core.delete_temp_files()
     while #core.projects > 0 do core.remove_project(core.projects[#core.projects], true) end
     save_session()
+    renderer.save_glyph_cache()
     quit_fn()
   else
     core.confirm_close_docs(core.docs, core.exit, quit_fn, true)
@@ -712,11 +715,46 @@ function core.add_thread(f, weak_ref, ...)
   assert(core.threads[key] == nil, "Duplicate thread reference")
   local args = {...}
   local fn = function() return core.try(f, table.unpack(args)) end
-  core.threads[key] = { cr = coroutine.create(fn), wake = 0 }
+  core.threads[key] = { cr = coroutine.create(fn), wake = 0, priority = scheduler.REDRAW }
+  scheduler.add(core.threads, key)
   return key
 end
 
 
+local thread_priorities = {
+  input = scheduler.INPUT,
+  redraw = scheduler.REDRAW,
+  background = scheduler.BACKGROUND
+}
+
+---Threads waking at the same time are resumed by priority. Input threads
+---run even once the time allowed for threads in a frame is spent,
+---background ones only once no other thread is waiting.
+---@param key any the key returned by core.add_thread
+---@param priority "input"|"redraw"|"background"
+function core.set_thread_priority(key, priority)
+  local thread = core.threads[key]
+  assert(thread, "Unknown thread reference")
+  thread.priority = assert(thread_priorities[priority], "Invalid thread priority")
+  scheduler.add(core.threads, key)
+end
+
+
+---@param key any the key returned by core.add_thread
+---@return { priority: integer, runs: integer, time: number, max_time: number, wake: number }?
+function core.get_thread_stats(key)
+  local thread = core.threads[key]
+  if not thread then return nil end
+  return {
+    priority = thread.priority,
+    runs = thread.runs or 0,
+    time = thread.time or 0,
+    max_time = thread.max_time or 0,
+    wake = thread.wake
+  }
+end
+
+
 function core.push_clip_rect(x, y, w, h)
   local x2, y2, w2, h2 = table.unpack(core.clip_rect_stack[#core.clip_rect_stack])
   local r, b, r2, b2 = x+w, y+h, x2+w2, y2+h2
@@ -988,48 +1026,18 @@ function core.step()
   core.clip_rect_stack[1] = { 0, 0, width, height }
   renderer.set_clip_rect(table.unpack(core.clip_rect_stack[1]))
   core.root_view:draw()
-  renderer.end_frame()
+  -- glyphs that could not be rasterized in time were drawn as placeholders
+  if renderer.end_frame() then core.redraw = true end
   return true
 end
 
 
-local run_threads = coroutine.wrap(function()
-  while true do
-    local max_time = 1 / config.fps - 0.004
-    local minimal_time_to_wake = math.huge
-
-    local threads = {}
-    -- We modify core.threads while iterating, both by removing dead threads,
-    -- and by potentially adding more threads while we yielded early,
-    -- so we need to extract the threads list and iterate over that instead.
-    for k, thread in pairs(core.threads) do
-      threads[k] = thread
-    end
-
-    for k, thread in pairs(threads) do
-      -- Run thread if it wasn't deleted externally and it's time to resume it
-      if core.threads[k] and thread.wake < system.get_time() then
-        local _, wait = assert(coroutine.resume(thread.cr))
-        if coroutine.status(thread.cr) == "dead" then
-          core.threads[k] = nil
-        else
-          wait = wait or (1/30)
-          thread.wake = system.get_time() + wait
-          minimal_time_to_wake = math.min(minimal_time_to_wake, wait)
-        end
-      else
-        minimal_time_to_wake =  math.min(minimal_time_to_wake, thread.wake - system.get_time())
-      end
-
-      -- stop running threads if we're about to hit the end of frame
-      if system.get_time() - core.frame_start > max_time then
-        coroutine.yield(0, false)
-      end
-    end
-
-    coroutine.yield(minimal_time_to_wake, true)
-  end
-end)
+-- threads are kept by the scheduler by wake time and priority, the ones due
+-- are resumed until the end of the frame is near
+local function run_threads()
+  local max_time = 1 / config.fps - 0.004
+  return scheduler.run(core.threads, core.frame_start + max_time)
+end
 
 
 function core.run()
@@ -1056,6 +1064,8 @@ function core.run()
     if core.restart_request or core.quit_request then break end
 
     if not did_redraw then
+      -- queued glyphs are rasterized while idle, without waiting until they're done
+      local prewarming = renderer.prewarm_glyphs()
       if system.window_has_focus(core.window) or not did_step or run_threads_full < 2 then
         local now = system.get_time()
         if not next_step then -- compute the time until the next blink
@@ -1065,9 +1075,11 @@ function core.run()
           local cursor_time_to_wake = dt + 1 / config.fps
           next_step = now + cursor_time_to_wake
         end
-        if system.wait_event(math.min(next_step - now, time_to_wake)) then
+        if system.wait_event(prewarming and 0 or math.min(next_step - now, time_to_wake)) then
           next_step = nil -- if we've recevied an event, perform a step
         end
+      elseif prewarming then
+        if system.wait_event(0) then next_step = nil end
       else
         system.wait_event()
         next_step = nil -- perform a step when we're not in focus if get we an event
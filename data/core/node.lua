@@ -612,6 +612,18 @@ function Node:draw_tabs()
 end
 
 
+-- replays the retained layer of a view when it has a valid one, otherwise
+-- draws the view, recording the layer again if it is retained
+local function draw_view(view)
+  local native = view.native
+  if not native then return view:draw() end
+  if native:draw_layer() then return end
+  native:begin_layer()
+  view:draw()
+  native:end_layer()
+end
+
+
 function Node:draw()
   if self.type == "leaf" then
     if self:should_show_tabs() then
@@ -619,7 +631,7 @@ function Node:draw()
     end
     local pos, size = self.active_view.position, self.active_view.size
     core.push_clip_rect(pos.x, pos.y, size.x, size.y)
-    self.active_view:draw()
+    draw_view(self.active_view)
     core.pop_clip_rect()
   else
     local x, y, w, h = self:get_divider_rect()
@@ -68,6 +68,21 @@ local title_commands = {{
     end
 }}
 
+-- parsed once, the other configurations are parsed again when the style or the size changes
+local spacer_config = clay.element_config({
+    layout = {
+        sizing = {
+            width = {
+                type = "grow"
+            }
+        }
+    }
+})
+
+local function opaque(color)
+    return {color[1], color[2], color[3], 255}
+end
+
 local TitleBar = View:extend()
 
 function TitleBar:new()
@@ -150,6 +165,92 @@ function TitleBar:get_item_at(x, y)
     return nil
 end
 
+-- the configurations of the bar, its items and controls, hovered or not
+function TitleBar:get_clay_configs()
+    local key = self.clay_configs_key
+    if key and key.font == style.font and key.icon_font == style.icon_font and key.text == style.text and key.dim ==
+        style.dim and key.selection == style.selection and key.background2 == style.background2 and key.scale ==
+        SCALE and key.width == self.size.x and key.height == self.size.y then
+        return self.clay_configs
+    end
+
+    self.clay_configs_key = {
+        font = style.font,
+        icon_font = style.icon_font,
+        text = style.text,
+        dim = style.dim,
+        selection = style.selection,
+        background2 = style.background2,
+        scale = SCALE,
+        width = self.size.x,
+        height = self.size.y
+    }
+
+    local item_layout = {
+        padding = {
+            x = 10 * SCALE,
+            y = 5 * SCALE
+        }
+    }
+    local control_text = {
+        font = style.icon_font,
+        fontSize = style.icon_font:get_size(),
+        color = opaque(style.dim)
+    }
+    local control_text_hovered = {
+        font = style.icon_font,
+        fontSize = style.icon_font:get_size(),
+        color = opaque(style.text)
+    }
+    self.clay_configs = {
+        root = clay.element_config({
+            layout = {
+                sizing = {
+                    width = {
+                        type = "fixed",
+                        value = self.size.x
+                    },
+                    height = {
+                        type = "fixed",
+                        value = self.size.y
+                    }
+                },
+                layoutDirection = "leftToRight",
+                childAlignment = {
+                    y = "center"
+                },
+                padding = {
+                    x = 10 * SCALE
+                }
+            },
+            backgroundColor = opaque(style.background2)
+        }),
+        item = clay.element_config({
+            layout = item_layout,
+            backgroundColor = {0, 0, 0, 0}
+        }),
+        item_hovered = clay.element_config({
+            layout = item_layout,
+            backgroundColor = opaque(style.selection)
+        }),
+        item_text = clay.text_config({
+            font = style.font,
+            fontSize = style.font:get_size(),
+            color = opaque(style.text)
+        }),
+        control = clay.element_config({
+            layout = {
+                padding = {
+                    x = 10 * SCALE
+                }
+            }
+        }),
+        control_text = clay.text_config(control_text),
+        control_text_hovered = clay.text_config(control_text_hovered)
+    }
+    return self.clay_configs
+end
+
 function TitleBar:update()
     self.menu:update()
     title_commands[2] = core.window_mode == "maximized" and restore_command or maximize_command
@@ -165,104 +266,40 @@ function TitleBar:draw()
 
     clay.begin_layout()
 
-    -- Root element
-    clay.open_element()
-    clay.configure_element({
-        layout = {
-            sizing = {
-                width = {
-                    type = "fixed",
-                    value = self.size.x
-                },
-                height = {
-                    type = "fixed",
-                    value = self.size.y
-                }
-            },
-            layoutDirection = "leftToRight",
-            childAlignment = {
-                y = "center"
-            },
-            padding = {
-                x = 10 * SCALE
-            }
-        },
-        backgroundColor = {style.background2[1], style.background2[2], style.background2[3], 255}
-    })
+    -- the whole bar is submitted in one call
+    local configs = self:get_clay_configs()
+    local root = {
+        config = configs.root
+    }
 
     -- Items
     for i, item in ipairs(self.items) do
         local id = clay.id("TitleBarItem" .. i)
-        clay.open_element()
-
-        local hovered = clay.pointer_over(id)
-        local bg_color = {0, 0, 0, 0}
-        if hovered or self.open_menu_name == item.text then
-            bg_color = {style.selection[1], style.selection[2], style.selection[3], 255}
-        end
-
-        clay.configure_element({
+        local hovered = clay.pointer_over(id) or self.open_menu_name == item.text
+        table.insert(root, {
+            config = hovered and configs.item_hovered or configs.item,
             id = id,
-            layout = {
-                padding = {
-                    x = 10 * SCALE,
-                    y = 5 * SCALE
-                }
-            },
-            backgroundColor = bg_color
+            { text = item.text, config = configs.item_text }
         })
-
-        clay.text(item.text, {
-            font = style.font,
-            fontSize = style.font:get_size(),
-            color = {style.text[1], style.text[2], style.text[3], 255}
-        })
-
-        clay.close_element()
     end
 
     -- Spacer
-    clay.open_element()
-    clay.configure_element({
-        layout = {
-            sizing = {
-                width = {
-                    type = "grow"
-                }
-            }
-        }
-    })
-    clay.close_element()
+    table.insert(root, { config = spacer_config })
 
     -- Controls
     if self.borderless then
         for i, item in ipairs(title_commands) do
             local id = clay.id("TitleBarControl" .. i)
-            clay.open_element()
-
             local hovered = clay.pointer_over(id)
-            local color = hovered and style.text or style.dim
-
-            clay.configure_element({
+            table.insert(root, {
+                config = configs.control,
                 id = id,
-                layout = {
-                    padding = {
-                        x = 10 * SCALE
-                    }
-                }
+                { text = item.symbol, config = hovered and configs.control_text_hovered or configs.control_text }
             })
-
-            clay.text(item.symbol, {
-                font = style.icon_font,
-                fontSize = style.icon_font:get_size(),
-                color = {color[1], color[2], color[3], 255}
-            })
-
-            clay.close_element()
         end
     end
 
-    clay.close_element() -- Root
+    clay.submit(root)
 
     clay.render(core.window)
 
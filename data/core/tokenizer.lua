@@ -5,6 +5,54 @@ local config = require "core.config"
 local tokenizer = {}
 local bad_patterns = {}
 
+-- Token types are interned natively into dense integer ids, so that
+-- highlighted lines can store `{ id, length, ... }` pairs and color/font
+-- lookups become array indexing. The name <-> id mapping is mirrored here
+-- to avoid crossing into C for every token.
+local type_ids, type_names = {}, {}
+
+---Initial tokenizer state, the handle of the empty subsyntax stack.
+tokenizer.INITIAL_STATE = tokentable.INITIAL_STATE
+
+---Return the dense integer id of a token type.
+---@param type string
+---@return integer
+function tokenizer.get_type_id(type)
+  local id = type_ids[type]
+  if not id then
+    id = tokentable.type_id(type)
+    type_ids[type] = id
+    type_names[id] = type
+  end
+  return id
+end
+
+---Return the token type name of an id returned by `tokenizer.get_type_id`.
+---@param id integer
+---@return string?
+function tokenizer.get_type_name(id)
+  return type_names[id]
+end
+
+---Return the number of token types registered so far.
+---@return integer
+function tokenizer.get_type_count()
+  return #type_names
+end
+
+---Map each registered token type id to the value of `by_name[type]`,
+---e.g. to build a color palette from `style.syntax`.
+---@param by_name table<string, any>
+---@param dest? table
+---@return table<integer, any>
+function tokenizer.map_types(by_name, dest)
+  dest = dest or {}
+  for id = 1, #type_names do
+    dest[id] = by_name[type_names[id]]
+  end
+  return dest
+end
+
 local function push_token(t, type, text)
   if not text or #text == 0 then return end
   type = type or "normal"
@@ -68,8 +116,15 @@ end
 -- Calling `push_subsyntax` appends the current subsyntax pattern index to the
 -- state and increases the stack depth. Calling `pop_subsyntax` clears the
 -- last appended subsyntax and decreases the stack.
+--
+-- The byte strings are interned by the native `tokentable` module and
+-- handled here as integer handles, so pushing and popping subsyntaxes does
+-- not build new strings and states can be compared as numbers.
 
 local function retrieve_syntax_state(incoming_syntax, state)
+  if type(state) == "number" then
+    state = tokentable.state_string(state)
+  end
   local current_syntax, subsyntax_info, current_pattern_idx, current_level =
     incoming_syntax, nil, state:byte(1) or 0, 1
   if
@@ -103,10 +158,13 @@ end
 
 ---Return the list of syntaxes used in the specified state.
 ---@param base_syntax table @The initial base syntax (the syntax of the file)
----@param state string @The state of the tokenizer to extract from
+---@param state integer|string @The state of the tokenizer to extract from
 ---@return table @Array of syntaxes starting from the innermost one
 function tokenizer.extract_subsyntaxes(base_syntax, state)
   local current_syntax
+  if type(state) == "number" then
+    state = tokentable.state_string(state)
+  end
   local t = {}
   repeat
     current_syntax = retrieve_syntax_state(base_syntax, state)
@@ -130,12 +188,12 @@ end
 
 ---@param incoming_syntax table
 ---@param text string
----@param state string
+---@param state? integer
 function tokenizer.tokenize(incoming_syntax, text, state, resume)
   local res
   local i = 1
 
-  state = state or string.char(0)
+  state = state or tokenizer.INITIAL_STATE
 
   if #incoming_syntax.patterns == 0 then
     return { "normal", text }, state
@@ -155,7 +213,7 @@ function tokenizer.tokenize(incoming_syntax, text, state, resume)
   res = res or {}
 
   -- incoming_syntax    : the parent syntax of the file.
-  -- state              : a string of bytes representing syntax state (see above)
+  -- state              : a handle to the syntax state (see above)
 
   -- current_syntax     : the syntax we're currently in.
   -- subsyntax_info     : info about the delimiters of this subsyntax.
@@ -167,18 +225,7 @@ function tokenizer.tokenize(incoming_syntax, text, state, resume)
   -- Should be used to set the state variable. Don't modify it directly.
   local function set_subsyntax_pattern_idx(pattern_idx)
     current_pattern_idx = pattern_idx
-    local state_len = #state
-    if current_level > state_len then
-      state = state .. string.char(pattern_idx)
-    elseif state_len == 1 then
-      state = string.char(pattern_idx)
-    else
-      state = ("%s%s%s"):format(
-        state:sub(1,current_level-1),
-        string.char(pattern_idx),
-        state:sub(current_level+1)
-      )
-    end
+    state = tokentable.state_set(state, current_level, pattern_idx)
   end
 
 
@@ -193,7 +240,7 @@ function tokenizer.tokenize(incoming_syntax, text, state, resume)
 
   local function pop_subsyntax()
     current_level = current_level - 1
-    state = string.sub(state, 1, current_level)
+    state = tokentable.state_truncate(state, current_level)
     set_subsyntax_pattern_idx(0)
     current_syntax, subsyntax_info, current_pattern_idx, current_level =
       retrieve_syntax_state(incoming_syntax, state)
@@ -275,7 +322,7 @@ function tokenizer.tokenize(incoming_syntax, text, state, resume)
       if system.get_time() - start_time > 0.5 / config.fps then
         -- We're out of time
         push_token(res, "incomplete", string.usub(text, i))
-        return res, string.char(0), {
+        return res, tokenizer.INITIAL_STATE, {
           res = res,
           i = i,
           state = state
@@ -414,4 +461,35 @@ function tokenizer.each_token(t)
 end
 
 
+---Pack a `{ type, text, ... }` token list into `{ type_id, length, ... }`
+---pairs, where length is in bytes. The text is not stored, it is recovered
+---from the tokenized line when iterating.
+---@param t table
+---@return integer[]
+function tokenizer.pack_tokens(t)
+  local packed = {}
+  for i = 1, #t, 2 do
+    packed[i] = tokenizer.get_type_id(t[i])
+    packed[i + 1] = #t[i + 1]
+  end
+  return packed
+end
+
+---Iterate packed tokens the same way as `tokenizer.each_token`.
+---@param t integer[] @Tokens returned by `tokenizer.pack_tokens`
+---@param text string @The line the tokens were generated from
+function tokenizer.each_packed_token(t, text)
+  local pos = 1
+  return function(_, i)
+    i = i + 2
+    local id, len = t[i], t[i + 1]
+    if id then
+      local s = pos
+      pos = pos + len
+      return i, type_names[id], text:sub(s, pos - 1)
+    end
+  end, t, -1
+end
+
+
 return tokenizer
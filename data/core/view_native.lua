@@ -130,6 +130,19 @@ end
 function View:draw(surface)
 end
 
+---Opt in or out of a retained layer: what `draw` draws is recorded and
+---replayed on the next frames, until `invalidate` is called or the position,
+---size or clip of the view change.
+---@param retained boolean
+function View:set_retained(retained)
+    self.native:set_retained(retained)
+end
+
+---Mark the view as dirty, drawing it again on the next frame.
+function View:invalidate()
+    self.native:invalidate_layer()
+end
+
 function View:draw_background(color)
     local renderer = require "renderer"
     local x, y = self.position.x, self.position.y
@@ -184,7 +184,7 @@ end
 --
 local global_symbols = {}
 
-core.add_thread(function()
+local symbols_thread = core.add_thread(function()
     local function load_syntax_symbols(doc)
         if doc.syntax and not autocomplete.map["language_" .. doc.syntax.name] then
             local symbols = {
@@ -286,6 +286,7 @@ core.add_thread(function()
 
     end
 end)
+core.set_thread_priority(symbols_thread, "background")
 
 local partial = ""
 local suggestions_offset = 1
@@ -73,6 +73,7 @@ function ResultsView:begin_search(path, text, fn)
     self.brightness = 100
     core.redraw = true
   end, self.results)
+  core.set_thread_priority(self.results, "background")
 
   self.scroll.to.y = 0
 end
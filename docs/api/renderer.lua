@@ -100,6 +100,22 @@ function renderer.font:set_size(size) end
 ---@return string | table<integer, string>
 function renderer.font:get_path() end
 
+---
+---Get the memory used by the glyph cache of the font, summed over the fonts
+---of a group. Atlas surfaces are kept under `budget`, the least recently
+---used ones are evicted and their glyphs rasterized again when drawn.
+---Fonts of the same file, size and options share one cache.
+---
+---@return { bytes: integer, atlas_bytes: integer, budget: integer, surfaces: integer, glyphs: integer, loads: integer, evictions: integer }
+function renderer.font:get_cache_stats() end
+
+---
+---Queue the glyphs of a text to be rasterized in the time left after the
+---next frames, so that drawing it later does not wait on the rasterizer.
+---
+---@param text string
+function renderer.font:prewarm(text) end
+
 ---
 ---Toggles drawing debugging rectangles on the currently rendered sections
 ---of the window to help troubleshoot the renderer.
@@ -123,8 +139,43 @@ function renderer.begin_frame(window) end
 ---
 ---Tell the rendering system that we finished building the frame.
 ---
+---Glyphs are only rasterized for a few milliseconds per frame, the ones left
+---over are drawn as placeholders and the frame must be drawn again.
+---
+---@return boolean redraw true if the frame contains placeholders
 function renderer.end_frame() end
 
+---
+---Set the directory where rasterized glyphs are saved, fonts loaded
+---afterwards restore their glyphs from it instead of rasterizing them again.
+---
+---@param dir? string nil disables the glyph cache
+function renderer.set_glyph_cache_dir(dir) end
+
+---
+---Save the rasterized glyphs of all loaded fonts to the glyph cache directory.
+---
+---@return boolean saved false if there is no directory or it can't be written
+function renderer.save_glyph_cache() end
+
+---
+---Rasterize the glyphs queued by `renderer.font:prewarm` for a few
+---milliseconds, to be called while idle.
+---
+---@return boolean pending true if glyphs are still queued
+function renderer.prewarm_glyphs() end
+
+---
+---Time translucent rectangle fills against the scaled blit they replaced,
+---over several rectangle sizes in the pixel format of the window.
+---Only available when built with `-Drenderer_debug=true`.
+---
+---@param window renwindow
+---@param iterations? integer fills per size, 100 by default
+---@param color? renderer.color an opaque color is drawn half transparent
+---@return { width: integer, height: integer, fill: number, blit: number }[] timings microseconds per call
+function renderer.benchmark_rects(window, iterations, color) end
+
 ---
 ---Set the region of the screen where draw operations will take effect.
 ---
@@ -144,6 +195,18 @@ function renderer.set_clip_rect(x, y, width, height) end
 ---@param color renderer.color
 function renderer.draw_rect(x, y, width, height, color) end
 
+---
+---Hint that the content of a region moved vertically by dy since the previous
+---frame. The pixels already drawn are moved, and only the parts of the region
+---that differ from the previous frame once moved are drawn again.
+---
+---@param x number
+---@param y number
+---@param width number
+---@param height number
+---@param dy integer
+function renderer.scroll_rect(x, y, width, height, dy) end
+
 ---
 ---Draw text and return the x coordinate where the text finished drawing.
 ---
@@ -24,6 +24,15 @@ function renwindow.create(title, width, height) end
 ---@return number height
 function renwindow.get_size(window) end
 
+---
+---Get what was copied to the screen, for the last presented frame and in
+---total. Frames where nothing changed are not presented and not counted.
+---
+---@param window renwindow
+---
+---@return { bytes: integer, rects: integer, uploads: integer, total_bytes: integer, frames: integer }
+function renwindow.get_upload_stats(window) end
+
 ---
 ---Restore Window
 ---
@@ -0,0 +1,41 @@
+---@meta
+
+---
+---Native queue of the threads added with core.add_thread, ordered by
+---priority and wake time.
+---@class scheduler
+scheduler = {}
+
+---Threads that respond to input, resumed even once the frame budget is spent.
+---@type integer
+scheduler.INPUT = 1
+
+---Threads whose work is drawn in the next frames, the default.
+---@type integer
+scheduler.REDRAW = 2
+
+---Threads that are resumed only once no other thread is waiting.
+---@type integer
+scheduler.BACKGROUND = 3
+
+---
+---Schedule the thread stored at `threads[key]`, a table with at least the
+---`cr` coroutine, its `wake` time and `priority` fields. Scheduling a thread
+---again, e.g. after changing its priority, replaces its previous entry.
+---
+---@param threads table
+---@param key any
+function scheduler.add(threads, key) end
+
+---
+---Resume the threads that are due, most urgent priority first and each one
+---at most once, until the deadline is passed. Threads that finish are
+---removed from `threads`. The `time`, `max_time` and `runs` fields of the
+---threads are updated along.
+---
+---@param threads table
+---@param deadline number time as returned by system.get_time()
+---
+---@return number time_to_wake seconds until the next thread is due
+---@return boolean done false if threads were still due at the deadline
+function scheduler.run(threads, deadline) end
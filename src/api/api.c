@@ -10,6 +10,8 @@ int luaopen_utf8extra(lua_State* L);
 int luaopen_clay(lua_State* L);
 int luaopen_view(lua_State* L);
 int luaopen_buffer(lua_State* L);
+int luaopen_tokentable(lua_State* L);
+int luaopen_scheduler(lua_State* L);
 
 static const luaL_Reg libs[] = {
   { "system",     luaopen_system     },
@@ -22,6 +24,8 @@ static const luaL_Reg libs[] = {
   { "clay",       luaopen_clay       },
   { "view",       luaopen_view       },
   { "buffer",     luaopen_buffer     },
+  { "tokentable", luaopen_tokentable },
+  { "scheduler",  luaopen_scheduler  },
   { NULL, NULL }
 };
 
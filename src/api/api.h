@@ -2,12 +2,14 @@
 #define API_H
 
 #include "../lua_compat.h"
+#include "../renderer.h"
 
 #define API_TYPE_FONT "Font"
 #define API_TYPE_PROCESS "Process"
 #define API_TYPE_DIRMONITOR "Dirmonitor"
 #define API_TYPE_NATIVE_PLUGIN "NativePlugin"
 #define API_TYPE_RENWINDOW "RenWindow"
+#define API_TYPE_BUFFER "Buffer"
 
 #ifdef _WIN32
   #define API_EXPORT __declspec(dllexport)
@@ -20,4 +22,15 @@
 
 void api_load_libs(lua_State *L);
 
+/* renderer.c helpers for bindings that draw text without renderer.draw_text */
+bool api_font_retrieve(lua_State *L, RenFont **fonts, int idx);
+void api_font_reference(lua_State *L, int idx);
+RenColor api_checkcolor(lua_State *L, int idx, int def);
+/* the fonts referenced between begin and end are also stored as keys of the
+** table at idx, returns false if another capture is in progress */
+bool api_font_begin_capture(lua_State *L, int idx);
+void api_font_end_capture(lua_State *L);
+/* references the fonts stored as keys of the table at idx for this frame */
+void api_font_reference_all(lua_State *L, int idx);
+
 #endif
@@ -1,6 +1,6 @@
 #include <cstring>
+#include <memory>
 #include <vector>
-#include <string>
 
 extern "C" {
 #include "api.h"
@@ -8,29 +8,112 @@ extern "C" {
 #include "lua_compat.h"
 #include "rencache.h"
 #include "renwindow.h"
+
+// defined by the Clay implementation, the hash its own text measurement cache uses
+uint64_t Clay__HashData(const uint8_t *data, size_t length);
 }
 
 #include "clay_renderer.hpp"
 #include "clay_rencache.hpp"
 
+#define API_TYPE_CLAY_ELEMENT "ClayElementConfig"
+#define API_TYPE_CLAY_TEXT "ClayTextConfig"
+
+// a text configuration, the font group is registered with the renderer on every use
+struct ClayTextConfig {
+  Clay_TextElementConfig config;
+  clay::FontGroup group;
+  bool has_font;
+  // keeps the fonts of a configuration handle alive
+  int font_ref;
+};
+
 static Clay_Arena clay_arena;
 static Clay_Context *clay_context = nullptr;
 static int clay_open_depth = 0; // tracks open/close balance
-static std::vector<std::string> clay_string_storage;
+
+// strings handed to Clay must stay valid until the layout is rendered. Short strings are
+// copied to a bump arena, longer ones are pinned in a registry table and used in place;
+// both are reset by begin_layout
+#define CLAY_STRING_CHUNK_SIZE (16 * 1024)
+#define CLAY_STRING_COPY_MAX 64
+
+struct ClayStringArena {
+  std::vector<std::unique_ptr<char[]>> chunks;
+  size_t chunk = 0, used = 0;
+};
+
+static ClayStringArena clay_strings;
+static int clay_pinned_ref = LUA_NOREF;
+static int clay_pinned_count = 0, clay_pinned_high = 0;
 
 namespace clay {
 ClayRenderer *g_clay_renderer = nullptr;
 }
 
+// the declarations of a layout are hashed as they are made. A layout equal to the previous
+// one is not computed again: Clay keeps the bounding boxes of its elements across layouts,
+// and the rencache commands of the previous one are replayed
+struct ClayRetainedLayout {
+  RenLayer *layer = nullptr;
+  RenWindow *window = nullptr;
+  uint64_t fingerprint = 0;
+  int32_t count = 0;
+  bool valid = false;
+};
+
+static ClayRetainedLayout clay_retained;
+static uint64_t clay_fingerprint = 0;
+static Clay_Dimensions clay_dimensions = {0, 0};
+// scroll containers may still move with no new declaration
+static bool clay_scrolled = false;
+
+static void Fingerprint(const void *data, size_t len) {
+  const uint8_t *bytes = static_cast<const uint8_t*>(data);
+  uint64_t h = clay_fingerprint;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ bytes[i]) * 1099511628211ULL;
+  }
+  clay_fingerprint = h;
+}
+
+static void FingerprintTag(char tag) {
+  Fingerprint(&tag, 1);
+}
+
+// Clay measures every word of the text it lays out, the measurements are kept across layouts
+// in a direct-mapped table; entries of an older font generation are stale, as font ids are
+// given out again once a font is freed or resized
+#define CLAY_MEASURE_CACHE_SIZE 4096
+
+struct MeasuredText {
+  uint64_t hash;
+  int32_t length;
+  uint16_t fontId;
+  unsigned int generation;
+  Clay_Dimensions dimensions;
+};
+
+static MeasuredText clay_measure_cache[CLAY_MEASURE_CACHE_SIZE];
+
 static Clay_Dimensions MeasureText(Clay_StringSlice text,
                                    Clay_TextElementConfig *config,
                                    void *userData) {
   clay::FontGroup* group = clay::ClayRencache::GetFont(config->fontId);
   if (group) {
+      unsigned int generation = ren_font_get_generation();
+      uint64_t hash = Clay__HashData(reinterpret_cast<const uint8_t*>(text.chars), text.length);
+      MeasuredText *entry = &clay_measure_cache[(hash ^ (hash >> 32) ^ config->fontId) & (CLAY_MEASURE_CACHE_SIZE - 1)];
+      if (entry->generation == generation && entry->hash == hash
+          && entry->length == text.length && entry->fontId == config->fontId) {
+          return entry->dimensions;
+      }
+
       int x_offset;
       double width = ren_font_group_get_width(group->fonts.data(), text.chars, text.length, {0}, &x_offset);
       float height = ren_font_group_get_height(group->fonts.data());
-      return {static_cast<float>(width), height};
+      *entry = {hash, text.length, config->fontId, generation, {static_cast<float>(width), height}};
+      return entry->dimensions;
   }
   float charWidth = config->fontSize * 0.6f;
   return {.width = text.length * charWidth,
@@ -85,6 +168,7 @@ static int l_clay_set_dimensions(lua_State *L) {
   float height = static_cast<float>(luaL_checknumber(L, 2));
 
   Clay_SetLayoutDimensions({width, height});
+  clay_dimensions = {width, height};
   return 0;
 }
 
@@ -97,16 +181,71 @@ static int l_clay_set_pointer(lua_State *L) {
   return 0;
 }
 
+static const char *CopyString(const char *text, size_t len) {
+  if (clay_strings.chunk < clay_strings.chunks.size() && clay_strings.used + len > CLAY_STRING_CHUNK_SIZE) {
+    clay_strings.chunk++;
+    clay_strings.used = 0;
+  }
+  if (clay_strings.chunk == clay_strings.chunks.size()) {
+    clay_strings.chunks.emplace_back(new char[CLAY_STRING_CHUNK_SIZE]);
+  }
+  char *copy = clay_strings.chunks[clay_strings.chunk].get() + clay_strings.used;
+  memcpy(copy, text, len);
+  clay_strings.used += len;
+  return copy;
+}
+
+// the string at idx, valid until the next layout begins
+static const char *StoreString(lua_State *L, int idx, size_t *len) {
+  idx = lua_absindex(L, idx);
+  const char *text = lua_tolstring(L, idx, len);
+  if (!text || *len <= CLAY_STRING_COPY_MAX) {
+    return text ? CopyString(text, *len) : nullptr;
+  }
+  if (clay_pinned_ref == LUA_NOREF) {
+    lua_newtable(L);
+    clay_pinned_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, clay_pinned_ref);
+  lua_pushvalue(L, idx);
+  lua_rawseti(L, -2, ++clay_pinned_count);
+  lua_pop(L, 1);
+  return text;
+}
+
+static void ResetStrings(lua_State *L) {
+  clay_strings.chunk = 0;
+  clay_strings.used = 0;
+  // slots are reused by the next layout, only the ones it won't overwrite are cleared
+  if (clay_pinned_ref != LUA_NOREF && clay_pinned_high > clay_pinned_count) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, clay_pinned_ref);
+    for (int i = clay_pinned_count + 1; i <= clay_pinned_high; i++) {
+      lua_pushnil(L);
+      lua_rawseti(L, -2, i);
+    }
+    lua_pop(L, 1);
+  }
+  clay_pinned_high = clay_pinned_count;
+  clay_pinned_count = 0;
+}
+
 static int l_clay_begin_layout(lua_State *L) {
   clay_open_depth = 0;
-  clay_string_storage.clear();
-  clay::ClayRencache::ResetFonts();
+  ResetStrings(L);
+  clay::ClayRencache::ValidateFonts();
   Clay_BeginLayout();
+
+  clay_fingerprint = 1469598103934665603ULL;
+  unsigned int generation = ren_font_get_generation();
+  Fingerprint(&clay_dimensions, sizeof(clay_dimensions));
+  Fingerprint(&generation, sizeof(generation));
   return 0;
 }
 
 static int l_clay_end_layout(lua_State *L) {
   Clay_RenderCommandArray commands = Clay_EndLayout();
+  // the commands are not submitted through the retained layer
+  clay_retained.valid = false;
   lua_pushinteger(L, commands.length);
 
   return 1;
@@ -114,6 +253,7 @@ static int l_clay_end_layout(lua_State *L) {
 
 static int l_clay_open_element(lua_State *L) {
   Clay__OpenElement();
+  FingerprintTag('(');
   clay_open_depth++;
   return 0;
 }
@@ -124,6 +264,7 @@ static int l_clay_close_element(lua_State *L) {
   }
   clay_open_depth--;
   Clay__CloseElement();
+  FingerprintTag(')');
   return 0;
 }
 
@@ -169,20 +310,35 @@ static Clay_SizingAxis ParseSizingAxis(lua_State* L) {
     return axis;
 }
 
-static int l_clay_configure_element(lua_State *L) {
-  if (!lua_istable(L, 1)) {
-    return luaL_error(L, "Expected table for element configuration");
-  }
+static Clay_Color ParseColor(lua_State* L, int idx) {
+  idx = lua_absindex(L, idx);
+  Clay_Color color;
+  lua_rawgeti(L, idx, 1);
+  color.r = static_cast<float>(lua_tonumber(L, -1));
+  lua_pop(L, 1);
+  lua_rawgeti(L, idx, 2);
+  color.g = static_cast<float>(lua_tonumber(L, -1));
+  lua_pop(L, 1);
+  lua_rawgeti(L, idx, 3);
+  color.b = static_cast<float>(lua_tonumber(L, -1));
+  lua_pop(L, 1);
+  lua_rawgeti(L, idx, 4);
+  color.a = static_cast<float>(lua_tonumber(L, -1));
+  lua_pop(L, 1);
+  return color;
+}
 
+static Clay_ElementDeclaration ParseElementDeclaration(lua_State *L, int idx) {
+  idx = lua_absindex(L, idx);
   Clay_ElementDeclaration config = {};
 
-  lua_getfield(L, 1, "id");
+  lua_getfield(L, idx, "id");
   if (lua_isnumber(L, -1)) {
       config.id = { static_cast<uint32_t>(lua_tointeger(L, -1)) };
   }
   lua_pop(L, 1);
 
-  lua_getfield(L, 1, "layout");
+  lua_getfield(L, idx, "layout");
   if (lua_istable(L, -1)) {
     Clay_LayoutConfig layoutConfig = {};
 
@@ -282,93 +438,203 @@ static int l_clay_configure_element(lua_State *L) {
   }
   lua_pop(L, 1);
 
-  lua_getfield(L, 1, "backgroundColor");
+  lua_getfield(L, idx, "backgroundColor");
   if (lua_istable(L, -1)) {
-    lua_rawgeti(L, -1, 1);
-    float r = static_cast<float>(lua_tonumber(L, -1));
-    lua_pop(L, 1);
-    lua_rawgeti(L, -1, 2);
-    float g = static_cast<float>(lua_tonumber(L, -1));
-    lua_pop(L, 1);
-    lua_rawgeti(L, -1, 3);
-    float b = static_cast<float>(lua_tonumber(L, -1));
-    lua_pop(L, 1);
-    lua_rawgeti(L, -1, 4);
-    float a = static_cast<float>(lua_tonumber(L, -1));
-    lua_pop(L, 1);
-    config.backgroundColor = {r, g, b, a};
+    config.backgroundColor = ParseColor(L, -1);
   }
   lua_pop(L, 1);
 
+  return config;
+}
+
+// an element configuration, either a table or a handle made by clay.element_config
+static Clay_ElementDeclaration CheckElementDeclaration(lua_State *L, int idx) {
+  Clay_ElementDeclaration *handle = (Clay_ElementDeclaration *)luaL_testudata(L, idx, API_TYPE_CLAY_ELEMENT);
+  if (handle) {
+    return *handle;
+  }
+  if (!lua_istable(L, idx)) {
+    luaL_error(L, "Expected table for element configuration");
+  }
+  return ParseElementDeclaration(L, idx);
+}
+
+static void ConfigureOpenElement(const Clay_ElementDeclaration& config) {
+  Fingerprint(&config, sizeof(config));
   Clay__ConfigureOpenElement(config);
-  return 0;
 }
 
-static int l_clay_text(lua_State *L) {
-  const char *text = luaL_checkstring(L, 1);
-  
-  clay_string_storage.emplace_back(text);
-  const std::string& storedText = clay_string_storage.back();
+static int l_clay_configure_element(lua_State *L) {
+  ConfigureOpenElement(CheckElementDeclaration(L, 1));
+  return 0;
+}
 
-  Clay_TextElementConfig textConfig = {};
-  textConfig.fontSize = 14;
-  textConfig.textColor = {0, 0, 0, 255};
+static void ParseTextConfig(lua_State *L, int idx, ClayTextConfig& text) {
+  idx = lua_absindex(L, idx);
+  text.config = {};
+  text.config.fontSize = 14;
+  text.config.textColor = {0, 0, 0, 255};
+  text.has_font = false;
+  text.font_ref = LUA_NOREF;
 
-  if (lua_istable(L, 2)) {
-    lua_getfield(L, 2, "fontSize");
+  if (lua_istable(L, idx)) {
+    lua_getfield(L, idx, "fontSize");
     if (lua_isnumber(L, -1)) {
-      textConfig.fontSize = static_cast<uint16_t>(lua_tointeger(L, -1));
+      text.config.fontSize = static_cast<uint16_t>(lua_tointeger(L, -1));
     }
     lua_pop(L, 1);
 
-    lua_getfield(L, 2, "color");
+    lua_getfield(L, idx, "color");
     if (lua_istable(L, -1)) {
-      lua_rawgeti(L, -1, 1);
-      textConfig.textColor.r = static_cast<float>(lua_tonumber(L, -1));
-      lua_pop(L, 1);
-      lua_rawgeti(L, -1, 2);
-      textConfig.textColor.g = static_cast<float>(lua_tonumber(L, -1));
-      lua_pop(L, 1);
-      lua_rawgeti(L, -1, 3);
-      textConfig.textColor.b = static_cast<float>(lua_tonumber(L, -1));
-      lua_pop(L, 1);
-      lua_rawgeti(L, -1, 4);
-      textConfig.textColor.a = static_cast<float>(lua_tonumber(L, -1));
-      lua_pop(L, 1);
+      text.config.textColor = ParseColor(L, -1);
     }
     lua_pop(L, 1);
 
-    lua_getfield(L, 2, "font");
+    lua_getfield(L, idx, "font");
     if (!lua_isnil(L, -1)) {
-        clay::FontGroup group;
-        if (retrieve_font_group(L, -1, group)) {
-            textConfig.fontId = clay::ClayRencache::AddFont(group);
-        }
+      text.has_font = retrieve_font_group(L, -1, text.group);
     }
     lua_pop(L, 1);
   }
+}
+
+static void OpenText(lua_State *L, int text_idx, const ClayTextConfig& textConfig) {
+  size_t len;
+  const char *text = StoreString(L, text_idx, &len);
+  if (!text) {
+    luaL_error(L, "Expected string for text");
+  }
+
+  Clay_TextElementConfig config = textConfig.config;
+  if (textConfig.has_font) {
+    config.fontId = clay::ClayRencache::AddFont(textConfig.group);
+  }
 
   Clay_String clayString = {
     .isStaticallyAllocated = false,
-    .length = static_cast<int32_t>(storedText.length()),
-    .chars = storedText.c_str()
+    .length = static_cast<int32_t>(len),
+    .chars = text
   };
 
-  Clay__OpenTextElement(clayString, Clay__StoreTextElementConfig(textConfig));
+  FingerprintTag('t');
+  Fingerprint(&config, sizeof(config));
+  Fingerprint(&len, sizeof(len));
+  Fingerprint(text, len);
+
+  Clay__OpenTextElement(clayString, Clay__StoreTextElementConfig(config));
+}
+
+// a text configuration, either a table, nil or a handle made by clay.text_config
+static void OpenTextWithConfig(lua_State *L, int text_idx, int config_idx) {
+  text_idx = lua_absindex(L, text_idx);
+  ClayTextConfig *handle = (ClayTextConfig *)luaL_testudata(L, config_idx, API_TYPE_CLAY_TEXT);
+  if (handle) {
+    OpenText(L, text_idx, *handle);
+  } else {
+    ClayTextConfig textConfig;
+    ParseTextConfig(L, config_idx, textConfig);
+    OpenText(L, text_idx, textConfig);
+  }
+}
+
+static int l_clay_text(lua_State *L) {
+  luaL_checkstring(L, 1);
+  OpenTextWithConfig(L, 1, 2);
+  return 0;
+}
+
+static int l_clay_element_config(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  Clay_ElementDeclaration config = ParseElementDeclaration(L, 1);
+  Clay_ElementDeclaration *handle = (Clay_ElementDeclaration *)lua_newuserdata(L, sizeof(Clay_ElementDeclaration));
+  *handle = config;
+  luaL_setmetatable(L, API_TYPE_CLAY_ELEMENT);
+  return 1;
+}
 
+static int l_clay_text_config(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  ClayTextConfig *handle = (ClayTextConfig *)lua_newuserdata(L, sizeof(ClayTextConfig));
+  ParseTextConfig(L, 1, *handle);
+  luaL_setmetatable(L, API_TYPE_CLAY_TEXT);
+  if (handle->has_font) {
+    lua_getfield(L, 1, "font");
+    handle->font_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  return 1;
+}
+
+static int l_clay_text_config_gc(lua_State *L) {
+  ClayTextConfig *handle = (ClayTextConfig *)luaL_checkudata(L, 1, API_TYPE_CLAY_TEXT);
+  luaL_unref(L, LUA_REGISTRYINDEX, handle->font_ref);
+  handle->font_ref = LUA_NOREF;
+  return 0;
+}
+
+// opens the element or text of a node and its children, see l_clay_submit
+static void SubmitNode(lua_State *L, int idx) {
+  idx = lua_absindex(L, idx);
+  luaL_checkstack(L, 4, "clay tree too deep");
+
+  lua_getfield(L, idx, "text");
+  if (!lua_isnil(L, -1)) {
+    lua_getfield(L, idx, "config");
+    OpenTextWithConfig(L, -2, -1);
+    lua_pop(L, 2);
+    return;
+  }
+  lua_pop(L, 1);
+
+  Clay__OpenElement();
+  FingerprintTag('(');
+  clay_open_depth++;
+
+  Clay_ElementDeclaration config = {};
+  lua_getfield(L, idx, "config");
+  if (!lua_isnil(L, -1)) {
+    config = CheckElementDeclaration(L, -1);
+  }
+  lua_pop(L, 1);
+  // ids usually change more often than the rest of the configuration
+  lua_getfield(L, idx, "id");
+  if (lua_isnumber(L, -1)) {
+    config.id = { static_cast<uint32_t>(lua_tointeger(L, -1)) };
+  }
+  lua_pop(L, 1);
+  ConfigureOpenElement(config);
+
+  int count = static_cast<int>(lua_rawlen(L, idx));
+  for (int i = 1; i <= count; i++) {
+    lua_rawgeti(L, idx, i);
+    if (!lua_istable(L, -1)) {
+      luaL_error(L, "clay:submit expected a table as child node");
+    }
+    SubmitNode(L, -1);
+    lua_pop(L, 1);
+  }
+
+  clay_open_depth--;
+  Clay__CloseElement();
+  FingerprintTag(')');
+}
+
+// submits a whole subtree at once; a node is either an element,
+// { config = <config>, id = <id>, <child nodes>... }, or a text, { text = <string>, config = <text config> }
+static int l_clay_submit(lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  SubmitNode(L, 1);
   return 0;
 }
 
 static int l_clay_id(lua_State *L) {
-  const char *idString = luaL_checkstring(L, 1);
-  
-  clay_string_storage.emplace_back(idString);
-  const std::string& storedId = clay_string_storage.back();
+  size_t len;
+  const char *idString = luaL_checklstring(L, 1, &len);
 
+  // only hashed, the string doesn't need to outlive the call
   Clay_String clayString = {
     .isStaticallyAllocated = false,
-    .length = static_cast<int32_t>(storedId.length()),
-    .chars = storedId.c_str()
+    .length = static_cast<int32_t>(len),
+    .chars = idString
   };
 
   Clay_ElementId id = Clay__HashString(clayString, 0, 0);
@@ -412,6 +678,7 @@ static int l_clay_update_scroll(lua_State *L) {
   float deltaTime = static_cast<float>(luaL_checknumber(L, 4));
 
   Clay_UpdateScrollContainers(enableDrag, {scrollX, scrollY}, deltaTime);
+  clay_scrolled = true;
   return 0;
 }
 
@@ -438,14 +705,35 @@ static int l_clay_render(lua_State *L) {
 
   if (!clay::g_clay_renderer) {
     clay::g_clay_renderer = new clay::ClayRenderer();
-    clay::g_clay_renderer->Initialize(window);
+  }
+  // the commands must reach the window the layer is recorded for
+  clay::g_clay_renderer->Initialize(window);
+
+  if (!clay_retained.layer) {
+    clay_retained.layer = rencache_layer_new();
+  }
+
+  // the debug view depends on more than the declarations
+  bool unchanged = clay_retained.valid && !clay_scrolled && !Clay_IsDebugModeEnabled()
+    && clay_retained.window == window && clay_retained.fingerprint == clay_fingerprint;
+  if (unchanged && rencache_draw_layer(window, clay_retained.layer)) {
+    // closes the root element, as Clay_EndLayout would
+    Clay__CloseElement();
+    lua_pushinteger(L, clay_retained.count);
+    return 1;
   }
 
   Clay_RenderCommandArray commands = Clay_EndLayout();
 
-  // rencache_begin_frame(window);
+  rencache_begin_layer(window, clay_retained.layer);
   clay::g_clay_renderer->RenderCommands(commands);
-  // rencache_end_frame(window);
+  rencache_end_layer(window, clay_retained.layer);
+
+  clay_retained.window = window;
+  clay_retained.fingerprint = clay_fingerprint;
+  clay_retained.count = commands.length;
+  clay_retained.valid = true;
+  clay_scrolled = false;
 
   lua_pushinteger(L, commands.length);
   return 1;
@@ -461,6 +749,9 @@ static const luaL_Reg clay_lib[] = {
     {"close_element", l_clay_close_element},
     {"configure_element", l_clay_configure_element},
     {"text", l_clay_text},
+    {"element_config", l_clay_element_config},
+    {"text_config", l_clay_text_config},
+    {"submit", l_clay_submit},
     {"id", l_clay_id},
     {"pointer_over", l_clay_pointer_over},
     {"get_element_data", l_clay_get_element_data},
@@ -472,6 +763,14 @@ static const luaL_Reg clay_lib[] = {
 
 extern "C" {
 int luaopen_clay(lua_State *L) {
+  luaL_newmetatable(L, API_TYPE_CLAY_ELEMENT);
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, API_TYPE_CLAY_TEXT);
+  lua_pushcfunction(L, l_clay_text_config_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
   luaL_newlib(L, clay_lib);
 
   lua_pushinteger(L, CLAY_LEFT_TO_RIGHT);
@@ -6,11 +6,13 @@ extern "C"
 }
 
 #include "views/View.hpp"
+#include "views/DocView.hpp"
 #include "views/renviews/ViewRenderer.hpp"
 
 using namespace view;
 
 #define API_TYPE_VIEW "View"
+#define API_TYPE_LINE_OFFSETS "LineOffsets"
 
 static View *checkview(lua_State *L, int idx)
 {
@@ -43,6 +45,25 @@ static int l_view_new(lua_State *L)
   return 1;
 }
 
+// View.new_doc_view()
+static int l_view_new_doc_view(lua_State *L)
+{
+  View *view = new (std::nothrow) DocView();
+  if (!view)
+  {
+    return luaL_error(L, "Failed to allocate DocView");
+  }
+  pushview(L, view);
+  return 1;
+}
+
+static DocView *checkdocview(lua_State *L, int idx)
+{
+  DocView *docView = dynamic_cast<DocView *>(checkview(L, idx));
+  luaL_argcheck(L, docView != nullptr, idx, "`DocView` expected");
+  return docView;
+}
+
 // View:__gc()
 static int l_view_gc(lua_State *L)
 {
@@ -295,6 +316,73 @@ static int l_view_draw_background(lua_State *L)
   return 0;
 }
 
+// View:set_retained(retained)
+static int l_view_set_retained(lua_State *L)
+{
+  View *view = checkview(L, 1);
+  view->setRetained(lua_toboolean(L, 2));
+  return 0;
+}
+
+// View:invalidate_layer()
+static int l_view_invalidate_layer(lua_State *L)
+{
+  View *view = checkview(L, 1);
+  view->invalidateLayer();
+  return 0;
+}
+
+// View:begin_layer()
+// the fonts drawn with are kept in a table until the layer is recorded again
+static int l_view_begin_layer(lua_State *L)
+{
+  View *view = checkview(L, 1);
+  RenWindow *window = ren_get_target_window();
+  if (!window || !view->isRetained())
+  {
+    return 0;
+  }
+  lua_newtable(L);
+  if (api_font_begin_capture(L, -1))
+  {
+    if (view->layerFontsRef != LUA_NOREF)
+    {
+      luaL_unref(L, LUA_REGISTRYINDEX, view->layerFontsRef);
+    }
+    view->layerFontsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    view->beginLayer(window);
+  }
+  return 0;
+}
+
+// View:end_layer()
+static int l_view_end_layer(lua_State *L)
+{
+  View *view = checkview(L, 1);
+  RenWindow *window = ren_get_target_window();
+  if (window && view->endLayer(window))
+  {
+    api_font_end_capture(L);
+  }
+  return 0;
+}
+
+// View:draw_layer() -> boolean
+static int l_view_draw_layer(lua_State *L)
+{
+  View *view = checkview(L, 1);
+  RenWindow *window = ren_get_target_window();
+  bool drawn = window && view->drawLayer(window);
+  if (drawn)
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, view->layerFontsRef);
+    api_font_reference_all(L, -1);
+    lua_pop(L, 1);
+  }
+  lua_pushboolean(L, drawn);
+  return 1;
+}
+
 // View.position
 static int l_view_get_position(lua_State *L)
 {
@@ -487,6 +575,151 @@ static int l_view_get_current_scale_ptr(lua_State *L)
   return 1;
 }
 
+// DocView:set_palette(colors, fonts, count, default_font)
+// colors and fonts are indexed by token type id, missing fonts use default_font
+static int l_view_set_palette(lua_State *L)
+{
+  DocView *view = checkdocview(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  lua_Integer count = luaL_checkinteger(L, 4);
+
+  RenFont *defaultFonts[FONT_FALLBACK_MAX];
+  api_font_retrieve(L, defaultFonts, 5);
+  api_font_reference(L, 5);
+
+  std::vector<TokenStyle> styles(count > 0 ? (size_t)count + 1 : 1);
+  for (lua_Integer id = 1; id <= count; id++)
+  {
+    TokenStyle &style = styles[id];
+    lua_rawgeti(L, 2, id);
+    style.color = api_checkcolor(L, -1, 255);
+    lua_pop(L, 1);
+    if (lua_rawgeti(L, 3, id) != LUA_TNIL)
+    {
+      api_font_retrieve(L, style.fonts, -1);
+      api_font_reference(L, -1);
+    }
+    lua_pop(L, 1);
+  }
+  view->setPalette(std::move(styles), defaultFonts);
+  return 0;
+}
+
+// reads the packed { type_id, length } tokens of a highlighter line table
+static bool readtokens(lua_State *L, int idx, std::vector<TokenRun> &runs)
+{
+  int top = lua_gettop(L);
+  bool ok = false;
+  if (lua_type(L, idx) == LUA_TTABLE && lua_getfield(L, idx, "tokens") == LUA_TTABLE)
+  {
+    size_t n = lua_rawlen(L, -1);
+    for (size_t i = 1; i + 1 <= n; i += 2)
+    {
+      lua_rawgeti(L, -1, (lua_Integer)i);
+      lua_rawgeti(L, -2, (lua_Integer)i + 1);
+      lua_Integer type = lua_tointeger(L, -2);
+      lua_Integer length = lua_tointeger(L, -1);
+      lua_pop(L, 2);
+      runs.push_back({(syntax::TokenTypeId)type, length > 0 ? (size_t)length : 0});
+    }
+    ok = true;
+  }
+  lua_settop(L, top);
+  return ok;
+}
+
+// DocView:draw_lines(buffer, lines, first, last, x, y, line_height)
+// lines is the highlighter's line table with packed { type_id, length } tokens
+static int l_view_draw_lines(lua_State *L)
+{
+  DocView *view = checkdocview(L, 1);
+  buffer::RopeBuffer *buf = *(buffer::RopeBuffer **)luaL_checkudata(L, 2, API_TYPE_BUFFER);
+  luaL_checktype(L, 3, LUA_TTABLE);
+  lua_Integer first = luaL_checkinteger(L, 4);
+  lua_Integer last = luaL_checkinteger(L, 5);
+  float x = luaL_checknumber(L, 6);
+  float y = luaL_checknumber(L, 7);
+  float lineHeight = luaL_checknumber(L, 8);
+
+  RenWindow *window = ren_get_target_window();
+  if (!window || first < 1 || last < first)
+  {
+    return 0;
+  }
+
+  view->drawLines(window, *buf, (size_t)first, (size_t)last, x, y, lineHeight,
+                  [L](size_t line, std::vector<TokenRun> &runs)
+                  {
+                    lua_rawgeti(L, 3, (lua_Integer)line);
+                    bool ok = readtokens(L, -1, runs);
+                    lua_pop(L, 1);
+                    return ok;
+                  });
+  return 0;
+}
+
+// returns the x offset table cached as `x_offsets` in the highlighter line
+// table (argument 3), measuring the line again if it is missing or was
+// measured with other fonts; the table is dropped along with the line
+// table when the line is edited or retokenized.
+// Expects the arguments (view, buffer, hl_line, line, *, tab_size).
+static LineOffsets *getlineoffsets(lua_State *L, DocView *view)
+{
+  const int hl_idx = 3;
+  buffer::RopeBuffer *buf = *(buffer::RopeBuffer **)luaL_checkudata(L, 2, API_TYPE_BUFFER);
+  luaL_checktype(L, hl_idx, LUA_TTABLE);
+  lua_Integer line = luaL_checkinteger(L, 4);
+  int tab_size = luaL_checkinteger(L, 6);
+
+  lua_getfield(L, hl_idx, "x_offsets");
+  LineOffsets **ud = (LineOffsets **)luaL_testudata(L, -1, API_TYPE_LINE_OFFSETS);
+  lua_pop(L, 1);
+  if (ud && (*ud)->key == view->getOffsetsKey(tab_size))
+  {
+    return *ud;
+  }
+
+  std::vector<TokenRun> runs;
+  readtokens(L, hl_idx, runs);
+  ud = (LineOffsets **)lua_newuserdata(L, sizeof(LineOffsets *));
+  *ud = new LineOffsets();
+  luaL_setmetatable(L, API_TYPE_LINE_OFFSETS);
+  size_t length = 0;
+  const char *text = line >= 1 ? buf->getLine((size_t)line, &length) : "";
+  view->measureLine(text, length, runs, tab_size, **ud);
+  lua_setfield(L, hl_idx, "x_offsets");
+  return *ud;
+}
+
+// DocView:get_col_x_offset(buffer, hl_line, line, col, tab_size)
+static int l_view_get_col_x_offset(lua_State *L)
+{
+  DocView *view = checkdocview(L, 1);
+  lua_Integer col = luaL_checkinteger(L, 5);
+  LineOffsets *offsets = getlineoffsets(L, view);
+  lua_pushnumber(L, DocView::colToX(*offsets, col > 0 ? (size_t)col : 0));
+  return 1;
+}
+
+// DocView:get_x_offset_col(buffer, hl_line, line, x, tab_size)
+static int l_view_get_x_offset_col(lua_State *L)
+{
+  DocView *view = checkdocview(L, 1);
+  double x = luaL_checknumber(L, 5);
+  LineOffsets *offsets = getlineoffsets(L, view);
+  lua_pushinteger(L, (lua_Integer)DocView::xToCol(*offsets, x));
+  return 1;
+}
+
+static int l_line_offsets_gc(lua_State *L)
+{
+  LineOffsets **ud = (LineOffsets **)luaL_checkudata(L, 1, API_TYPE_LINE_OFFSETS);
+  delete *ud;
+  *ud = nullptr;
+  return 0;
+}
+
 static const luaL_Reg view_methods[] = {
     {"__tostring", l_view_tostring},
     {"__gc", l_view_gc},
@@ -511,6 +744,11 @@ static const luaL_Reg view_methods[] = {
     {"update", l_view_update},
     {"draw", l_view_draw},
     {"draw_background", l_view_draw_background},
+    {"set_retained", l_view_set_retained},
+    {"invalidate_layer", l_view_invalidate_layer},
+    {"begin_layer", l_view_begin_layer},
+    {"end_layer", l_view_end_layer},
+    {"draw_layer", l_view_draw_layer},
     // Property accessors
     {"get_position", l_view_get_position},
     {"set_position", l_view_set_position},
@@ -531,10 +769,16 @@ static const luaL_Reg view_methods[] = {
     {"get_scroll_ptr", l_view_get_scroll_ptr},
     {"get_scrollable_ptr", l_view_get_scrollable_ptr},
     {"get_current_scale_ptr", l_view_get_current_scale_ptr},
+    // DocView
+    {"set_palette", l_view_set_palette},
+    {"draw_lines", l_view_draw_lines},
+    {"get_col_x_offset", l_view_get_col_x_offset},
+    {"get_x_offset_col", l_view_get_x_offset_col},
     {NULL, NULL}};
 
 static const luaL_Reg view_functions[] = {
     {"new", l_view_new},
+    {"new_doc_view", l_view_new_doc_view},
     {NULL, NULL}};
 
 extern "C"
@@ -547,6 +791,11 @@ extern "C"
     lua_pushvalue(L, -1);
     lua_setfield(L, -2, "__index");
 
+    luaL_newmetatable(L, API_TYPE_LINE_OFFSETS);
+    lua_pushcfunction(L, l_line_offsets_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
     // module table
     lua_newtable(L);
     luaL_setfuncs(L, view_functions, 0);
@@ -5,8 +5,6 @@ extern "C" {
 #include "api.h"
 }
 
-#define API_TYPE_BUFFER "Buffer"
-
 using namespace buffer;
 
 static RopeBuffer* checkbuffer(lua_State* L, int idx) {
@@ -11,6 +11,9 @@
 
 // a reference index to a table that stores the fonts
 static int RENDERER_FONT_REF = LUA_NOREF;
+// a reference index to a table that also stores the fonts referenced
+// while a retained layer is recorded
+static int RENDERER_CAPTURE_REF = LUA_NOREF;
 
 static int font_get_options(
   lua_State *L,
@@ -253,6 +256,36 @@ static int f_font_set_size(lua_State *L) {
   return 0;
 }
 
+static int f_font_prewarm(lua_State *L) {
+  RenFont* fonts[FONT_FALLBACK_MAX]; font_retrieve(L, fonts, 1);
+  size_t len;
+  const char *text = luaL_checklstring(L, 2, &len);
+  ren_font_group_queue_prewarm(fonts, text, len);
+  return 0;
+}
+
+static int f_font_get_cache_stats(lua_State *L) {
+  RenFont* fonts[FONT_FALLBACK_MAX]; font_retrieve(L, fonts, 1);
+  RenFontCacheStats stats;
+  ren_font_group_get_cache_stats(fonts, &stats);
+  lua_createtable(L, 0, 7);
+  lua_pushinteger(L, stats.bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, stats.atlas_bytes);
+  lua_setfield(L, -2, "atlas_bytes");
+  lua_pushinteger(L, stats.budget);
+  lua_setfield(L, -2, "budget");
+  lua_pushinteger(L, stats.surfaces);
+  lua_setfield(L, -2, "surfaces");
+  lua_pushinteger(L, stats.glyphs);
+  lua_setfield(L, -2, "glyphs");
+  lua_pushinteger(L, stats.loads);
+  lua_setfield(L, -2, "loads");
+  lua_pushinteger(L, stats.evictions);
+  lua_setfield(L, -2, "evictions");
+  return 1;
+}
+
 static int color_value_error(lua_State *L, int idx, int table_idx) {
   const char *type, *msg;
   // generate an appropriate error message
@@ -330,11 +363,14 @@ static int f_end_frame(UNUSED lua_State *L) {
   RenWindow *window = ren_get_target_window();
   assert(window != NULL);
   rencache_end_frame(window);
+  // rencache dirties the regions drawn with placeholders, the next frame draws them again
+  bool deferred = ren_font_glyphs_deferred();
   ren_set_target_window(NULL);
   // clear the font reference table
   lua_newtable(L);
   lua_rawseti(L, LUA_REGISTRYINDEX, RENDERER_FONT_REF);
-  return 0;
+  lua_pushboolean(L, deferred);
+  return 1;
 }
 
 
@@ -367,21 +403,44 @@ static int f_draw_rect(lua_State *L) {
   return 0;
 }
 
-static int f_draw_text(lua_State *L) {
-  RenFont* fonts[FONT_FALLBACK_MAX];
-  font_retrieve(L, fonts, 1);
+static int f_scroll_rect(lua_State *L) {
+  lua_Number x = luaL_checknumber(L, 1);
+  lua_Number y = luaL_checknumber(L, 2);
+  lua_Number w = luaL_checknumber(L, 3);
+  lua_Number h = luaL_checknumber(L, 4);
+  int dy = luaL_checkinteger(L, 5);
+  RenRect rect = rect_to_grid(x, y, w, h);
+  rencache_scroll_rect(ren_get_target_window(), rect, dy);
+  return 0;
+}
 
-  // stores a reference to this font to the reference table
+// stores a reference to the font at idx to the reference table,
+// keeping it alive until the end of the frame
+static void font_reference(lua_State *L, int idx) {
+  idx = lua_absindex(L, idx);
   lua_rawgeti(L, LUA_REGISTRYINDEX, RENDERER_FONT_REF);
   if (lua_istable(L, -1))
   {
-    lua_pushvalue(L, 1);
+    lua_pushvalue(L, idx);
     lua_pushboolean(L, 1);
     lua_rawset(L, -3);
   } else {
     fprintf(stderr, "warning: failed to reference count fonts\n");
   }
   lua_pop(L, 1);
+  if (RENDERER_CAPTURE_REF != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, RENDERER_CAPTURE_REF);
+    lua_pushvalue(L, idx);
+    lua_pushboolean(L, 1);
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+  }
+}
+
+static int f_draw_text(lua_State *L) {
+  RenFont* fonts[FONT_FALLBACK_MAX];
+  font_retrieve(L, fonts, 1);
+  font_reference(L, 1);
 
   size_t len;
   const char *text = luaL_checklstring(L, 2, &len);
@@ -394,6 +453,46 @@ static int f_draw_text(lua_State *L) {
   return 1;
 }
 
+static int f_set_glyph_cache_dir(lua_State *L) {
+  ren_font_set_glyph_cache_dir(luaL_optstring(L, 1, NULL));
+  return 0;
+}
+
+static int f_save_glyph_cache(lua_State *L) {
+  lua_pushboolean(L, ren_font_save_glyph_caches());
+  return 1;
+}
+
+static int f_prewarm_glyphs(lua_State *L) {
+  lua_pushboolean(L, ren_font_prewarm_glyphs());
+  return 1;
+}
+
+#ifdef RENDERER_DEBUG
+static int f_benchmark_rects(lua_State *L) {
+  RenWindow *window = *(RenWindow**)luaL_checkudata(L, 1, API_TYPE_RENWINDOW);
+  int iterations = luaL_optinteger(L, 2, 100);
+  RenColor color = checkcolor(L, 3, 255);
+  if (color.a == 0xff) color.a = 0x80;
+  RenRectTiming timings[8];
+  int count = ren_rect_benchmark(window, color, iterations, timings, 8);
+  lua_createtable(L, count, 0);
+  for (int i = 0; i < count; i++) {
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, timings[i].width);
+    lua_setfield(L, -2, "width");
+    lua_pushinteger(L, timings[i].height);
+    lua_setfield(L, -2, "height");
+    lua_pushnumber(L, timings[i].fill_us);
+    lua_setfield(L, -2, "fill");
+    lua_pushnumber(L, timings[i].blit_us);
+    lua_setfield(L, -2, "blit");
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+#endif
+
 static const luaL_Reg lib[] = {
   { "show_debug",         f_show_debug         },
   { "get_size",           f_get_size           },
@@ -402,6 +501,13 @@ static const luaL_Reg lib[] = {
   { "set_clip_rect",      f_set_clip_rect      },
   { "draw_rect",          f_draw_rect          },
   { "draw_text",          f_draw_text          },
+  { "scroll_rect",        f_scroll_rect        },
+  { "set_glyph_cache_dir", f_set_glyph_cache_dir },
+  { "save_glyph_cache",   f_save_glyph_cache   },
+  { "prewarm_glyphs",     f_prewarm_glyphs     },
+#ifdef RENDERER_DEBUG
+  { "benchmark_rects",    f_benchmark_rects    },
+#endif
   { NULL,                 NULL                 }
 };
 
@@ -416,9 +522,46 @@ static const luaL_Reg fontLib[] = {
   { "get_size",           f_font_get_size           },
   { "set_size",           f_font_set_size           },
   { "get_path",           f_font_get_path           },
+  { "get_cache_stats",    f_font_get_cache_stats    },
+  { "prewarm",            f_font_prewarm            },
   { NULL, NULL }
 };
 
+bool api_font_retrieve(lua_State *L, RenFont **fonts, int idx) {
+  return font_retrieve(L, fonts, idx);
+}
+
+void api_font_reference(lua_State *L, int idx) {
+  font_reference(L, idx);
+}
+
+bool api_font_begin_capture(lua_State *L, int idx) {
+  if (RENDERER_CAPTURE_REF != LUA_NOREF) {
+    return false;
+  }
+  lua_pushvalue(L, idx);
+  RENDERER_CAPTURE_REF = luaL_ref(L, LUA_REGISTRYINDEX);
+  return true;
+}
+
+void api_font_end_capture(lua_State *L) {
+  luaL_unref(L, LUA_REGISTRYINDEX, RENDERER_CAPTURE_REF);
+  RENDERER_CAPTURE_REF = LUA_NOREF;
+}
+
+void api_font_reference_all(lua_State *L, int idx) {
+  idx = lua_absindex(L, idx);
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    lua_pop(L, 1);
+    font_reference(L, -1);
+  }
+}
+
+RenColor api_checkcolor(lua_State *L, int idx, int def) {
+  return checkcolor(L, idx, def);
+}
+
 int luaopen_renderer(lua_State *L) {
   // gets a reference on the registry to store font data
   lua_newtable(L);
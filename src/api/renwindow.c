@@ -112,6 +112,23 @@ static int f_renwin_get_id(lua_State *L) {
   return 1;
 }
 
+static int f_renwin_get_upload_stats(lua_State *L) {
+  RenWindow *window_renderer = *(RenWindow**)luaL_checkudata(L, 1, API_TYPE_RENWINDOW);
+  const RenUploadStats *stats = &window_renderer->upload_stats;
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, stats->bytes);
+  lua_setfield(L, -2, "bytes");
+  lua_pushinteger(L, stats->rects);
+  lua_setfield(L, -2, "rects");
+  lua_pushinteger(L, stats->uploads);
+  lua_setfield(L, -2, "uploads");
+  lua_pushinteger(L, stats->total_bytes);
+  lua_setfield(L, -2, "total_bytes");
+  lua_pushinteger(L, stats->frames);
+  lua_setfield(L, -2, "frames");
+  return 1;
+}
+
 static const luaL_Reg renwindow_lib[] = {
   { "create",     f_renwin_create     },
   { "destroy",    f_renwin_destroy    },
@@ -121,6 +138,7 @@ static const luaL_Reg renwindow_lib[] = {
   { "_restore",   f_renwin_restore    },
   { "show",       f_renwin_show       },
   { "get_id",     f_renwin_get_id     },
+  { "get_upload_stats", f_renwin_get_upload_stats },
   {NULL, NULL}
 };
 
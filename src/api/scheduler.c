@@ -0,0 +1,356 @@
+#include "api.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL3/SDL.h>
+
+#define SCHEDULER_PRIORITIES 3
+#define SCHEDULER_DEFAULT_WAIT (1.0 / 30)
+
+typedef enum {
+  PRIORITY_INPUT = 1,
+  PRIORITY_REDRAW = 2,
+  PRIORITY_BACKGROUND = 3
+} ESchedulerPriority;
+
+// threads live in a table of records, key -> { cr, wake, priority, ... }, the
+// entries only name them by id: a thread removed from the table, or whose key
+// was collected, is dropped once its entry comes up
+typedef struct {
+  double wake;
+  uint64_t seq;
+  int id, priority;
+} SchedulerEntry;
+
+typedef struct {
+  SchedulerEntry *entries;
+  size_t count, capacity;
+} SchedulerHeap;
+
+typedef struct {
+  // one min-heap by wake time per priority
+  SchedulerHeap heaps[SCHEDULER_PRIORITIES];
+  // threads resumed during a run, scheduled again once it ends
+  SchedulerHeap pending;
+  uint64_t seq;
+  int next_id;
+  // id -> key, weak valued so the keys can still be collected
+  int keys_ref;
+} Scheduler;
+
+
+static double get_time(void) {
+  return SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+}
+
+
+static bool entry_before(const SchedulerEntry *a, const SchedulerEntry *b) {
+  return a->wake < b->wake || (a->wake == b->wake && a->seq < b->seq);
+}
+
+
+static bool heap_push(SchedulerHeap *heap, SchedulerEntry entry) {
+  if (heap->count == heap->capacity) {
+    size_t capacity = heap->capacity ? heap->capacity * 2 : 32;
+    SchedulerEntry *entries = SDL_realloc(heap->entries, capacity * sizeof(SchedulerEntry));
+    if (!entries) return false;
+    heap->entries = entries;
+    heap->capacity = capacity;
+  }
+  size_t i = heap->count++;
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!entry_before(&entry, &heap->entries[parent])) break;
+    heap->entries[i] = heap->entries[parent];
+    i = parent;
+  }
+  heap->entries[i] = entry;
+  return true;
+}
+
+
+static SchedulerEntry heap_pop(SchedulerHeap *heap) {
+  SchedulerEntry top = heap->entries[0];
+  SchedulerEntry last = heap->entries[--heap->count];
+  size_t i = 0;
+  for (;;) {
+    size_t child = i * 2 + 1;
+    if (child >= heap->count) break;
+    if (child + 1 < heap->count && entry_before(&heap->entries[child + 1], &heap->entries[child]))
+      child++;
+    if (!entry_before(&heap->entries[child], &last)) break;
+    heap->entries[i] = heap->entries[child];
+    i = child;
+  }
+  if (heap->count > 0)
+    heap->entries[i] = last;
+  return top;
+}
+
+
+static Scheduler* get_scheduler(lua_State *L) {
+  return (Scheduler*) lua_touserdata(L, lua_upvalueindex(1));
+}
+
+
+static int check_priority(lua_State *L, int idx) {
+  int priority = (int) luaL_optinteger(L, idx, PRIORITY_REDRAW);
+  if (priority < PRIORITY_INPUT || priority > PRIORITY_BACKGROUND)
+    return luaL_error(L, "invalid thread priority %d", priority);
+  return priority;
+}
+
+
+// pushes the record of an entry, or nothing if it is no longer scheduled
+static bool push_record(lua_State *L, Scheduler *s, int threads, int id) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, s->keys_ref);
+  lua_rawgeti(L, -1, id);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 2);
+    return false;
+  }
+  lua_gettable(L, threads);
+  if (lua_istable(L, -1)) {
+    lua_getfield(L, -1, "id");
+    bool current = lua_tointeger(L, -1) == id;
+    lua_pop(L, 1);
+    if (current) {
+      lua_remove(L, -2);
+      return true;
+    }
+  }
+  lua_pop(L, 2);
+  return false;
+}
+
+
+static void forget_key(lua_State *L, Scheduler *s, int id) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, s->keys_ref);
+  lua_pushnil(L);
+  lua_rawseti(L, -2, id);
+  lua_pop(L, 1);
+}
+
+
+static int f_add(lua_State *L) {
+  Scheduler *s = get_scheduler(L);
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checkany(L, 2);
+  lua_pushvalue(L, 2);
+  lua_gettable(L, 1);
+  if (!lua_istable(L, -1))
+    return luaL_error(L, "no thread with this key");
+  int record = lua_gettop(L);
+
+  lua_getfield(L, record, "priority");
+  int priority = check_priority(L, -1);
+  lua_getfield(L, record, "wake");
+  double wake = luaL_optnumber(L, -1, 0);
+  lua_pop(L, 2);
+
+  // an entry scheduled before under another id is now stale
+  int id = ++s->next_id;
+  lua_pushinteger(L, id);
+  lua_setfield(L, record, "id");
+  lua_rawgeti(L, LUA_REGISTRYINDEX, s->keys_ref);
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, -2, id);
+  lua_pop(L, 1);
+
+  SchedulerEntry entry = { wake, s->seq++, id, priority };
+  if (!heap_push(&s->heaps[priority - 1], entry))
+    return luaL_error(L, "unable to schedule thread: out of memory");
+  return 0;
+}
+
+
+// resumes co and leaves the value it yielded, or its error, on the stack of L
+static int resume_thread(lua_State *L, lua_State *co) {
+  int status, nres;
+  #if LUA_VERSION_NUM >= 504
+    status = lua_resume(co, L, 0, &nres);
+  #elif LUA_VERSION_NUM >= 502
+    status = lua_resume(co, L, 0);
+    nres = lua_gettop(co);
+  #else
+    status = lua_resume(co, 0);
+    nres = lua_gettop(co);
+  #endif
+  if (status != 0 && status != LUA_YIELD) {
+    lua_xmove(co, L, 1);
+  } else if (nres > 0) {
+    lua_pushvalue(co, -nres);
+    lua_xmove(co, L, 1);
+    lua_pop(co, nres);
+  } else {
+    lua_pushnil(L);
+  }
+  return status;
+}
+
+
+static void add_time(lua_State *L, int record, const char *field, double n, bool max) {
+  lua_getfield(L, record, field);
+  double value = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  lua_pushnumber(L, max ? (n > value ? n : value) : value + n);
+  lua_setfield(L, record, field);
+}
+
+
+// threads resumed during a run go back to their heap once it ends, so each
+// one is resumed once per run at most
+static bool flush_pending(Scheduler *s) {
+  bool ok = true;
+  for (size_t i = 0; i < s->pending.count; i++) {
+    SchedulerEntry *entry = &s->pending.entries[i];
+    ok = heap_push(&s->heaps[entry->priority - 1], *entry) && ok;
+  }
+  s->pending.count = 0;
+  return ok;
+}
+
+
+// removes the thread of an entry from the table of records
+static void remove_thread(lua_State *L, Scheduler *s, int threads, int id) {
+  lua_rawgeti(L, LUA_REGISTRYINDEX, s->keys_ref);
+  lua_rawgeti(L, -1, id);
+  if (!lua_isnil(L, -1)) {
+    lua_pushnil(L);
+    lua_settable(L, threads);
+  } else {
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  forget_key(L, s, id);
+}
+
+
+static int f_run(lua_State *L) {
+  Scheduler *s = get_scheduler(L);
+  luaL_checktype(L, 1, LUA_TTABLE);
+  double deadline = luaL_checknumber(L, 2);
+  double now = get_time();
+  bool done = true;
+
+  for (;;) {
+    // the most urgent priority with a thread to wake, input threads run even
+    // once the frame budget is spent
+    SchedulerHeap *heap = NULL;
+    int priority;
+    for (priority = PRIORITY_INPUT; priority <= PRIORITY_BACKGROUND; priority++) {
+      SchedulerHeap *h = &s->heaps[priority - 1];
+      if (h->count > 0 && h->entries[0].wake <= now) {
+        heap = h;
+        break;
+      }
+    }
+    if (!heap) break;
+    if (priority != PRIORITY_INPUT && now > deadline) {
+      done = false;
+      break;
+    }
+
+    SchedulerEntry entry = heap_pop(heap);
+    if (!push_record(L, s, 1, entry.id)) {
+      forget_key(L, s, entry.id);
+      continue;
+    }
+    int record = lua_gettop(L);
+    lua_getfield(L, record, "cr");
+    lua_State *co = lua_tothread(L, -1);
+    if (!co) {
+      remove_thread(L, s, 1, entry.id);
+      lua_settop(L, record - 1);
+      continue;
+    }
+
+    double start = get_time();
+    int status = resume_thread(L, co);
+    double end = get_time();
+    add_time(L, record, "time", end - start, false);
+    add_time(L, record, "max_time", end - start, true);
+    add_time(L, record, "runs", 1, false);
+    now = end;
+
+    if (status != 0 && status != LUA_YIELD) {
+      remove_thread(L, s, 1, entry.id);
+      flush_pending(s);
+      return lua_error(L);
+    }
+    if (status == 0) {
+      remove_thread(L, s, 1, entry.id);
+    } else {
+      double wait = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : SCHEDULER_DEFAULT_WAIT;
+      entry.wake = end + wait;
+      entry.seq = s->seq++;
+      lua_pushnumber(L, entry.wake);
+      lua_setfield(L, record, "wake");
+      // a thread that changed its priority while running was scheduled again
+      lua_getfield(L, record, "id");
+      bool current = lua_tointeger(L, -1) == entry.id;
+      lua_pop(L, 1);
+      if (current && !heap_push(&s->pending, entry)) {
+        flush_pending(s);
+        return luaL_error(L, "unable to schedule thread: out of memory");
+      }
+    }
+    lua_settop(L, record - 1);
+  }
+
+  if (!flush_pending(s))
+    return luaL_error(L, "unable to schedule thread: out of memory");
+
+  double time_to_wake = HUGE_VAL;
+  for (int i = 0; i < SCHEDULER_PRIORITIES; i++) {
+    SchedulerHeap *h = &s->heaps[i];
+    if (h->count > 0 && h->entries[0].wake - now < time_to_wake)
+      time_to_wake = h->entries[0].wake - now;
+  }
+  lua_pushnumber(L, done ? time_to_wake : 0);
+  lua_pushboolean(L, done);
+  return 2;
+}
+
+
+static int f_scheduler_gc(lua_State *L) {
+  Scheduler *s = (Scheduler*) lua_touserdata(L, 1);
+  for (int i = 0; i < SCHEDULER_PRIORITIES; i++)
+    SDL_free(s->heaps[i].entries);
+  SDL_free(s->pending.entries);
+  return 0;
+}
+
+
+static const luaL_Reg lib[] = {
+  { "add", f_add },
+  { "run", f_run },
+  { NULL,  NULL  }
+};
+
+
+int luaopen_scheduler(lua_State *L) {
+  lua_createtable(L, 0, sizeof(lib) / sizeof(lib[0]) - 1);
+
+  Scheduler *s = lua_newuserdata(L, sizeof(Scheduler));
+  SDL_memset(s, 0, sizeof(Scheduler));
+  lua_newtable(L);
+  lua_pushcfunction(L, f_scheduler_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_setmetatable(L, -2);
+
+  lua_newtable(L);
+  lua_newtable(L);
+  lua_pushstring(L, "v");
+  lua_setfield(L, -2, "__mode");
+  lua_setmetatable(L, -2);
+  s->keys_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  luaL_setfuncs(L, lib, 1);
+
+  API_CONSTANT_DEFINE(L, -1, "INPUT", PRIORITY_INPUT);
+  API_CONSTANT_DEFINE(L, -1, "REDRAW", PRIORITY_REDRAW);
+  API_CONSTANT_DEFINE(L, -1, "BACKGROUND", PRIORITY_BACKGROUND);
+  return 1;
+}
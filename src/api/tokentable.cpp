@@ -0,0 +1,124 @@
+extern "C"
+{
+#include "api.h"
+}
+
+#include "syntax/StateTable.hpp"
+#include "syntax/TokenTypes.hpp"
+
+using namespace syntax;
+
+static StateHandle checkstate(lua_State *L, int idx)
+{
+  lua_Integer state = luaL_checkinteger(L, idx);
+  luaL_argcheck(L, StateTable::getInstance().getBytes((StateHandle)state) != nullptr,
+                idx, "invalid tokenizer state");
+  return (StateHandle)state;
+}
+
+// tokentable.type_id(name: string) -> integer
+static int l_tokentable_type_id(lua_State *L)
+{
+  size_t len;
+  const char *name = luaL_checklstring(L, 1, &len);
+  TokenTypeId id = TokenTypeRegistry::getInstance().intern(name, len);
+  if (id == 0)
+  {
+    return luaL_error(L, "too many token types");
+  }
+  lua_pushinteger(L, id);
+  return 1;
+}
+
+// tokentable.type_name(id: integer) -> string|nil
+static int l_tokentable_type_name(lua_State *L)
+{
+  lua_Integer id = luaL_checkinteger(L, 1);
+  const std::string *name = (id > 0 && id <= 0xffff)
+                                ? TokenTypeRegistry::getInstance().getName((TokenTypeId)id)
+                                : nullptr;
+  if (!name)
+  {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_pushlstring(L, name->data(), name->size());
+  return 1;
+}
+
+// tokentable.type_count() -> integer
+static int l_tokentable_type_count(lua_State *L)
+{
+  lua_pushinteger(L, (lua_Integer)TokenTypeRegistry::getInstance().getCount());
+  return 1;
+}
+
+// tokentable.state_intern(bytes: string) -> integer
+static int l_tokentable_state_intern(lua_State *L)
+{
+  size_t len;
+  const char *bytes = luaL_checklstring(L, 1, &len);
+  lua_pushinteger(L, StateTable::getInstance().intern(bytes, len));
+  return 1;
+}
+
+// tokentable.state_set(state: integer, level: integer, pattern_idx: integer) -> integer
+static int l_tokentable_state_set(lua_State *L)
+{
+  StateHandle state = checkstate(L, 1);
+  lua_Integer level = luaL_checkinteger(L, 2);
+  lua_Integer idx = luaL_checkinteger(L, 3);
+  luaL_argcheck(L, level >= 0, 2, "invalid level");
+  luaL_argcheck(L, idx >= 0 && idx <= 255, 3, "pattern index out of range");
+  lua_pushinteger(L, StateTable::getInstance().setPatternIdx(state, (size_t)level, (uint8_t)idx));
+  return 1;
+}
+
+// tokentable.state_truncate(state: integer, length: integer) -> integer
+static int l_tokentable_state_truncate(lua_State *L)
+{
+  StateHandle state = checkstate(L, 1);
+  lua_Integer length = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, length >= 0, 2, "invalid length");
+  lua_pushinteger(L, StateTable::getInstance().truncate(state, (size_t)length));
+  return 1;
+}
+
+// tokentable.state_string(state: integer) -> string
+static int l_tokentable_state_string(lua_State *L)
+{
+  StateHandle state = checkstate(L, 1);
+  const std::string *bytes = StateTable::getInstance().getBytes(state);
+  lua_pushlstring(L, bytes->data(), bytes->size());
+  return 1;
+}
+
+// tokentable.state_count() -> integer
+static int l_tokentable_state_count(lua_State *L)
+{
+  lua_pushinteger(L, (lua_Integer)StateTable::getInstance().getCount());
+  return 1;
+}
+
+static const luaL_Reg tokentable_functions[] = {
+    {"type_id", l_tokentable_type_id},
+    {"type_name", l_tokentable_type_name},
+    {"type_count", l_tokentable_type_count},
+    {"state_intern", l_tokentable_state_intern},
+    {"state_set", l_tokentable_state_set},
+    {"state_truncate", l_tokentable_state_truncate},
+    {"state_string", l_tokentable_state_string},
+    {"state_count", l_tokentable_state_count},
+    {NULL, NULL}};
+
+extern "C"
+{
+  int luaopen_tokentable(lua_State *L)
+  {
+    lua_newtable(L);
+    luaL_setfuncs(L, tokentable_functions, 0);
+    lua_pushinteger(L, StateTable::INITIAL);
+    lua_setfield(L, -2, "INITIAL_STATE");
+    return 1;
+  }
+}
@@ -1,6 +1,8 @@
 #include "clay_rencache.hpp"
 #include <print>
 #include <algorithm>
+#include <cmath>
+#include <unordered_map>
 
 extern "C" {
 #include "rencache.h"
@@ -10,6 +12,8 @@ namespace clay {
 
 bool ClayRencache::initialized = false;
 static std::vector<FontGroup> fontRegistry;
+static std::unordered_map<FontGroup, uint16_t, FontGroupHash> fontIds;
+static unsigned int fontGeneration = 0;
 
 void ClayRencache::Initialize() {
     if (!initialized) {
@@ -18,8 +22,11 @@ void ClayRencache::Initialize() {
 }
 
 uint16_t ClayRencache::AddFont(const FontGroup& fontGroup) {
-    fontRegistry.push_back(fontGroup);
-    return static_cast<uint16_t>(fontRegistry.size() - 1);
+    auto [it, inserted] = fontIds.try_emplace(fontGroup, static_cast<uint16_t>(fontRegistry.size()));
+    if (inserted) {
+        fontRegistry.push_back(fontGroup);
+    }
+    return it->second;
 }
 
 FontGroup* ClayRencache::GetFont(uint16_t id) {
@@ -31,6 +38,18 @@ FontGroup* ClayRencache::GetFont(uint16_t id) {
 
 void ClayRencache::ResetFonts() {
     fontRegistry.clear();
+    fontIds.clear();
+}
+
+void ClayRencache::ValidateFonts() {
+    // a freed font may leave its address to another one
+    unsigned int generation = ren_font_get_generation();
+    if (generation != fontGeneration) {
+        ResetFonts();
+        // Clay caches measurements by font id too
+        Clay_ResetMeasureTextCache();
+        fontGeneration = generation;
+    }
 }
 
 // this function will check if bounding box intersects with clip rectangle
@@ -43,19 +62,61 @@ bool ClayRencache::ShouldRender(const Clay_BoundingBox& box, const Clay_Bounding
     return x2 > x1 && y2 > y1;
 }
 
+static Clay_BoundingBox IntersectClip(const Clay_BoundingBox& a, const Clay_BoundingBox& b) {
+    float x1 = std::max(a.x, b.x);
+    float y1 = std::max(a.y, b.y);
+    float x2 = std::min(a.x + a.width, b.x + b.width);
+    float y2 = std::min(a.y + a.height, b.y + b.height);
+    return {x1, y1, std::max(x2 - x1, 0.0f), std::max(y2 - y1, 0.0f)};
+}
+
+// partially covered pixels stay inside the clip
+static RenRect ClipToRect(const Clay_BoundingBox& clip) {
+    int x1 = static_cast<int>(std::floor(clip.x));
+    int y1 = static_cast<int>(std::floor(clip.y));
+    int x2 = static_cast<int>(std::ceil(clip.x + clip.width));
+    int y2 = static_cast<int>(std::ceil(clip.y + clip.height));
+    return {x1, y1, x2 - x1, y2 - y1};
+}
+
+static bool IsEmpty(const Clay_BoundingBox& clip) {
+    return clip.width <= 0 || clip.height <= 0;
+}
+
 void ClayRencache::RenderThroughRencache(RenWindow* window, const Clay_RenderCommandArray& commands) {
     if (!window) {
         fprintf(stderr, "Error: No window provided to Clay rencache rendering\n");
         return;
     }
     
-    // Current clip rectangle
-    Clay_BoundingBox currentClip = {0, 0, 10000, 10000}; // Will be set properly by clip commands
+    // scissors nest, each one is intersected with the enclosing clip, the outermost being
+    // the one rencache had before the commands
+    RenRect baseRect = rencache_get_clip_rect(window);
+    Clay_BoundingBox baseClip = {
+        static_cast<float>(baseRect.x),
+        static_cast<float>(baseRect.y),
+        static_cast<float>(baseRect.width),
+        static_cast<float>(baseRect.height)
+    };
+    static std::vector<Clay_BoundingBox> clipStack;
+    clipStack.clear();
+    Clay_BoundingBox currentClip = baseClip;
+    // depth of the scissor being skipped, within it nothing can be visible
+    int culledDepth = 0;
     for (int i = 0; i < commands.length; i++) {
         const Clay_RenderCommand* cmd = Clay_RenderCommandArray_Get(
             const_cast<Clay_RenderCommandArray*>(&commands), i);
         
         if (!cmd) continue;
+
+        if (culledDepth > 0) {
+            if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_SCISSOR_START) {
+                culledDepth++;
+            } else if (cmd->commandType == CLAY_RENDER_COMMAND_TYPE_SCISSOR_END) {
+                culledDepth--;
+            }
+            continue;
+        }
         
         // Skip the command if not visible within current clip
         if (cmd->commandType != CLAY_RENDER_COMMAND_TYPE_SCISSOR_START &&
@@ -155,22 +216,23 @@ void ClayRencache::RenderThroughRencache(RenWindow* window, const Clay_RenderCom
                 break;
             
             case CLAY_RENDER_COMMAND_TYPE_SCISSOR_START: {
-                currentClip = cmd->boundingBox;
-                RenRect rect = {
-                    static_cast<int>(cmd->boundingBox.x),
-                    static_cast<int>(cmd->boundingBox.y),
-                    static_cast<int>(cmd->boundingBox.width),
-                    static_cast<int>(cmd->boundingBox.height)
-                };
-                rencache_set_clip_rect(window, rect);
+                Clay_BoundingBox clip = IntersectClip(currentClip, cmd->boundingBox);
+                if (IsEmpty(clip)) {
+                    // the whole subtree is hidden, up to the matching end
+                    culledDepth = 1;
+                    break;
+                }
+                clipStack.push_back(currentClip);
+                currentClip = clip;
+                rencache_set_clip_rect(window, ClipToRect(currentClip));
                 break;
             }
             
             case CLAY_RENDER_COMMAND_TYPE_SCISSOR_END: {
-                // Reset to full screen clip
-                currentClip = {0, 0, 10000, 10000};
-                RenRect rect = {0, 0, 10000, 10000};
-                rencache_set_clip_rect(window, rect);
+                if (clipStack.empty()) break;
+                currentClip = clipStack.back();
+                clipStack.pop_back();
+                rencache_set_clip_rect(window, ClipToRect(currentClip));
                 break;
             }
             
@@ -180,6 +242,11 @@ void ClayRencache::RenderThroughRencache(RenWindow* window, const Clay_RenderCom
                 break;
         }
     }
+
+    // the commands that follow are drawn with the clip they had before
+    if (!clipStack.empty()) {
+        rencache_set_clip_rect(window, baseRect);
+    }
 }
 
 } // namespace clay
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <vector>
 
 extern "C" {
@@ -12,6 +13,18 @@ namespace clay {
 
 struct FontGroup {
     std::array<RenFont*, FONT_FALLBACK_MAX> fonts;
+
+    bool operator==(const FontGroup& other) const { return fonts == other.fonts; }
+};
+
+struct FontGroupHash {
+    size_t operator()(const FontGroup& group) const {
+        uint64_t h = 1469598103934665603ULL;
+        for (RenFont* font : group.fonts) {
+            h = (h ^ reinterpret_cast<uintptr_t>(font)) * 1099511628211ULL;
+        }
+        return static_cast<size_t>(h);
+    }
 };
 
 // birdge layer between Clay and rencache.h
@@ -25,9 +38,12 @@ public:
     // Check if a Clay element should be rendered
     static bool ShouldRender(const Clay_BoundingBox& box, const Clay_BoundingBox& clipRect);
 
+    // font groups keep their id across layouts, until a font is freed or resized
     static uint16_t AddFont(const FontGroup& fontGroup);
     static FontGroup* GetFont(uint16_t id);
     static void ResetFonts();
+    // forgets the registered groups if their fonts changed, ids must not be used across this call
+    static void ValidateFonts();
     
 private:
     static bool initialized;
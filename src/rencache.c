@@ -24,20 +24,34 @@
 /* a cache over the software renderer -- all drawing operations are stored as
 ** commands when issued. At the end of the frame we write the commands to a grid
 ** of hash values, take the cells that have changed since the previous frame,
-** merge them into dirty rectangles and redraw only those regions */
+** merge them into dirty rectangles and redraw only those regions. Large redraws
+** are split into horizontal bands rasterized in parallel by a pool of workers.
+** When a region is hinted as scrolled, its pixels are moved and the commands of
+** the previous frame are hashed moved by the same amount, so that only what has
+** really changed in the region is redrawn */
 
-#define CELLS_X 80
-#define CELLS_Y 50
-#define CELL_SIZE 96
+/* cells are as small as possible while keeping the grid under MAX_CELLS,
+** the cell size grows in steps of CELL_SIZE_STEP on larger windows */
+#define MIN_CELL_SIZE 32
+#define CELL_SIZE_STEP 16
+#define MAX_CELLS (128 * 128)
 #define CMD_BUF_RESIZE_RATE 1.2
 #define CMD_BUF_INIT_SIZE (1024 * 512)
 #define COMMAND_BARE_SIZE offsetof(Command, command)
+#define MAX_WORKERS 8
+/* smaller redraws are not worth waking up the workers */
+#define PARALLEL_MIN_AREA (512 * 512)
+#define MIN_BAND_HEIGHT 32
+#define MAX_SCROLL_RECTS 8
+#define MAX_DEFERRED_RECTS 16
 
-enum CommandType { SET_CLIP, DRAW_TEXT, DRAW_RECT };
+enum CommandType { SET_CLIP, DRAW_TEXT, DRAW_RECT, DRAW_TEXT_RUNS };
 
 typedef struct {
   enum CommandType type;
   uint32_t size;
+  /* hash of the type and contents, see seal_command */
+  uint64_t hash;
   /* Commands *must* always begin with a RenRect
   ** This is done to ensure alignment */
   RenRect command[];
@@ -64,29 +78,153 @@ typedef struct {
 } DrawRectCommand;
 
 typedef struct {
-  unsigned cells_buf1[CELLS_X * CELLS_Y];
-  unsigned cells_buf2[CELLS_X * CELLS_Y];
-  unsigned *cells_prev;
-  unsigned *cells;
-  RenRect rect_buf[CELLS_X * CELLS_Y / 2];
+  RenFont *fonts[FONT_FALLBACK_MAX];
+  RenColor color;
+  float x;
+  size_t offset;
+  size_t len;
+  int8_t tab_size;
+  RenTab tab;
+} TextRun;
+
+/* a line of text made of several runs, the text of all runs is stored
+** contiguously after `runs[run_capacity]` */
+typedef struct {
+  RenRect rect;
+  size_t run_count;
+  size_t run_capacity;
+  TextRun runs[];
+} DrawTextRunsCommand;
+
+/* a command drawn in a cell, and the SET_CLIP command it is drawn with */
+typedef struct {
+  uint32_t command;
+  uint32_t clip;
+} BinEntry;
+
+#define NO_CLIP UINT32_MAX
+
+typedef struct {
+  int cell;
+  BinEntry entry;
+} BinPair;
+
+/* commands gathered from the bins of a dirty rect */
+typedef struct {
+  BinEntry *entries;
+  size_t count, capacity;
+} CommandList;
+
+/* a band of the screen rasterized by one thread, through its own surface
+** sharing the pixels of the window surface so that clip rects don't collide */
+typedef struct RenWorker {
+  struct RenWorkerPool *pool;
+  SDL_Thread *thread;
+  SDL_Surface *surface;
+  RenRect band;
+  CommandList commands;
+} RenWorker;
+
+/* a region whose content moved by dy since the previous frame */
+typedef struct {
+  RenRect rect;
+  int dy;
+} ScrollRect;
+
+typedef struct RenWorkerPool {
+  SDL_Mutex *lock;
+  SDL_Condition *start, *done;
+  /* bumped to start rasterizing a frame */
+  unsigned generation;
+  int pending;
+  bool quit;
+  /* workers[0] is run by the main thread */
+  int worker_count;
+  RenWorker workers[MAX_WORKERS + 1];
+  RenWindow *window;
+  RenSurface rs;
+  int rect_count;
+} RenWorkerPool;
+
+typedef struct {
+  /* the grid covers the whole screen, cells_x * cells_y cells of cell_size points */
+  int cells_x, cells_y, cell_size;
+  uint64_t *cells_buf1;
+  uint64_t *cells_buf2;
+  uint64_t *cells_prev;
+  uint64_t *cells;
+  RenRect *rect_buf;
   bool resize_issue;
   RenRect screen_rect;
   RenRect last_clip_rect;
+  RenWorkerPool *pool;
+  /* commands binned by cell: the entries of a cell are
+  ** bin_entries[bin_start[idx]] to bin_entries[bin_start[idx + 1]] */
+  BinPair *bin_pairs;
+  size_t bin_count, bin_capacity;
+  BinEntry *bin_entries;
+  size_t bin_entries_capacity;
+  unsigned *bin_start;
+  bool bins_valid;
+  size_t command_count;
+  CommandList commands;
+  /* the commands of the previous frame, while the surface still holds them */
+  uint8_t *prev_command_buf;
+  size_t prev_command_buf_idx, prev_command_buf_size;
+  bool prev_valid;
+  ScrollRect scrolls[MAX_SCROLL_RECTS];
+  int scroll_count;
+  /* regions drawn with placeholder glyphs, drawn again on the next frame */
+  RenRect deferred[MAX_DEFERRED_RECTS];
+  int deferred_count;
 } RenCacheState;
 
+/* the commands recorded between rencache_begin_layer and rencache_end_layer,
+** copied back as they are into the command buffer of the next frames */
+struct RenLayer {
+  uint8_t *commands;
+  size_t size, capacity;
+  /* offset of the first command in the command buffer while recording */
+  size_t start;
+  bool recording, valid;
+  /* the clip the commands were recorded with, and the one they leave */
+  RenRect clip, end_clip;
+  unsigned int font_generation;
+};
+
 static bool show_debug;
 
 void rencache_init(RenWindow *window_renderer) {
+  /* the grid is allocated by rencache_begin_frame, once the size is known */
   RenCacheState *cache = SDL_calloc(1, sizeof(RenCacheState));
-  cache->cells_prev = cache->cells_buf1;
-  cache->cells = cache->cells_buf2;
-  memset(cache->cells_prev, 0xff, sizeof(cache->cells_buf1));
   window_renderer->cache_state = cache;
 }
 
+
+static void free_grid(RenCacheState *cache) {
+  SDL_free(cache->cells_buf1);
+  SDL_free(cache->cells_buf2);
+  SDL_free(cache->rect_buf);
+  SDL_free(cache->bin_start);
+  cache->cells_buf1 = cache->cells_buf2 = cache->cells = cache->cells_prev = NULL;
+  cache->rect_buf = NULL;
+  cache->bin_start = NULL;
+  cache->cells_x = cache->cells_y = 0;
+}
+
+
+static void pool_free(RenWorkerPool *pool);
+
 void rencache_free(RenWindow *window_renderer) {
   if (window_renderer->cache_state) {
-    SDL_free(window_renderer->cache_state);
+    RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+    pool_free(cache->pool);
+    free_grid(cache);
+    SDL_free(cache->bin_pairs);
+    SDL_free(cache->bin_entries);
+    SDL_free(cache->commands.entries);
+    SDL_free(cache->prev_command_buf);
+    SDL_free(cache);
     window_renderer->cache_state = NULL;
   }
 }
@@ -95,19 +233,95 @@ static inline int rencache_min(int a, int b) { return a < b ? a : b; }
 static inline int rencache_max(int a, int b) { return a > b ? a : b; }
 
 
-/* 32bit fnv-1a hash */
-#define HASH_INITIAL 2166136261
+/* 64bit hash of the commands, after xxHash64 */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+#define HASH_INITIAL 0xcbf29ce484222325ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME64_2;
+  return rotl64(acc, 31) * PRIME64_1;
+}
 
-static void hash(unsigned *h, const void *data, int size) {
-  const unsigned char *p = data;
-  while (size--) {
-    *h = (*h ^ *p++) * 16777619;
+static inline uint64_t hash_merge(uint64_t acc, uint64_t v) {
+  acc ^= hash_round(0, v);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t hash(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *p = data, *end = p + size;
+  uint64_t h;
+  if (size >= 32) {
+    /* four independent lanes */
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2, v2 = seed + PRIME64_2;
+    uint64_t v3 = seed, v4 = seed - PRIME64_1;
+    do {
+      v1 = hash_round(v1, read64(p));
+      v2 = hash_round(v2, read64(p + 8));
+      v3 = hash_round(v3, read64(p + 16));
+      v4 = hash_round(v4, read64(p + 24));
+      p += 32;
+    } while (p + 32 <= end);
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = hash_merge(h, v1);
+    h = hash_merge(h, v2);
+    h = hash_merge(h, v3);
+    h = hash_merge(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+  h += size;
+  for (; p + 8 <= end; p += 8) {
+    h = rotl64(h ^ hash_round(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+  }
+  if (p + 4 <= end) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    h = rotl64(h ^ (v * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
   }
+  for (; p < end; p++) {
+    h = rotl64(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+  }
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+
+/* mixes the hash of a command into a cell, commands are mixed in order */
+static inline void hash_cell(uint64_t *cell, uint64_t h) {
+  *cell = (*cell ^ h) * PRIME64_1;
 }
 
 
-static inline int cell_idx(int x, int y) {
-  return x + y * CELLS_X;
+static inline int cell_idx(RenCacheState *cache, int x, int y) {
+  return x + y * cache->cells_x;
+}
+
+
+/* range of cells overlapping r, including the cells r only touches */
+static void cell_range(RenCacheState *cache, RenRect r, int *x1, int *y1, int *x2, int *y2) {
+  *x1 = rencache_max(0, r.x / cache->cell_size);
+  *y1 = rencache_max(0, r.y / cache->cell_size);
+  *x2 = rencache_min((r.x + r.width) / cache->cell_size, cache->cells_x - 1);
+  *y2 = rencache_min((r.y + r.height) / cache->cell_size, cache->cells_y - 1);
 }
 
 
@@ -134,6 +348,39 @@ static RenRect merge_rects(RenRect a, RenRect b) {
   return (RenRect) { x1, y1, x2 - x1, y2 - y1 };
 }
 
+static bool resize_grid(RenCacheState *cache, int w, int h) {
+  int cell_size = MIN_CELL_SIZE;
+  while (((w + cell_size - 1) / cell_size) * ((h + cell_size - 1) / cell_size) > MAX_CELLS) {
+    cell_size += CELL_SIZE_STEP;
+  }
+  int cells_x = rencache_max(1, (w + cell_size - 1) / cell_size);
+  int cells_y = rencache_max(1, (h + cell_size - 1) / cell_size);
+  cache->cell_size = cell_size;
+  if (cells_x == cache->cells_x && cells_y == cache->cells_y) {
+    return true;
+  }
+
+  free_grid(cache);
+  size_t count = (size_t)cells_x * cells_y;
+  cache->cells_buf1 = SDL_malloc(count * sizeof(uint64_t));
+  cache->cells_buf2 = SDL_malloc(count * sizeof(uint64_t));
+  /* the moved regions are presented along with the dirty rects */
+  cache->rect_buf = SDL_malloc((count + MAX_SCROLL_RECTS) * sizeof(RenRect));
+  cache->bin_start = SDL_malloc((count + 1) * sizeof(unsigned));
+  if (!cache->cells_buf1 || !cache->cells_buf2 || !cache->rect_buf || !cache->bin_start) {
+    free_grid(cache);
+    return false;
+  }
+  cache->cells_x = cells_x;
+  cache->cells_y = cells_y;
+  cache->cells_prev = cache->cells_buf1;
+  cache->cells = cache->cells_buf2;
+  for (size_t i = 0; i < count; i++) {
+    cache->cells[i] = HASH_INITIAL;
+  }
+  return true;
+}
+
 static bool expand_command_buffer(RenWindow *window_renderer) {
   size_t new_size = window_renderer->command_buf_size * CMD_BUF_RESIZE_RATE;
   if (new_size == 0) {
@@ -177,6 +424,19 @@ static void* push_command(RenWindow *window_renderer, enum CommandType type, int
 }
 
 
+/* hashes the first `size` bytes of a command once it has been filled,
+** the padding of the command is left out. So is its vertical position, which
+** is mixed in relative to each cell, see row_key */
+static void seal_command(void *command, size_t size) {
+  Command *cmd = (Command*) ((char*) command - COMMAND_BARE_SIZE);
+  RenRect *rect = command, saved = *rect;
+  rect->y = 0;
+  if (cmd->type == SET_CLIP || cmd->type == DRAW_RECT) { rect->height = 0; }
+  cmd->hash = hash(command, size, cmd->type);
+  *rect = saved;
+}
+
+
 static bool next_command(RenWindow *window_renderer, Command **prev) {
   if (*prev == NULL) {
     *prev = (Command*) window_renderer->command_buf;
@@ -199,10 +459,19 @@ void rencache_set_clip_rect(RenWindow *window_renderer, RenRect rect) {
   if (cmd) {
     cmd->rect = intersect_rects(rect, cache->screen_rect);
     cache->last_clip_rect = cmd->rect;
+    seal_command(cmd, sizeof(SetClipCommand));
   }
 }
 
 
+/* the clip the next commands are drawn with, the whole screen if none was set */
+RenRect rencache_get_clip_rect(RenWindow *window_renderer) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache) return (RenRect) { 0 };
+  return cache->last_clip_rect;
+}
+
+
 void rencache_draw_rect(RenWindow *window_renderer, RenRect rect, RenColor color) {
   RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
   if (!cache) return;
@@ -213,6 +482,7 @@ void rencache_draw_rect(RenWindow *window_renderer, RenRect rect, RenColor color
   if (cmd) {
     cmd->rect = rect;
     cmd->color = color;
+    seal_command(cmd, sizeof(DrawRectCommand));
   }
 }
 
@@ -235,16 +505,162 @@ double rencache_draw_text(RenWindow *window_renderer, RenFont **fonts, const cha
       cmd->len = len;
       cmd->tab_size = ren_font_group_get_tab_size(fonts);
       cmd->tab = tab;
+      seal_command(cmd, sizeof(DrawTextCommand) + len);
     }
   }
   return x + width;
 }
 
 
+double rencache_draw_text_runs(RenWindow *window_renderer, const RenTextRun *runs, size_t count, double x, int y) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache || count == 0) return x;
+
+  size_t text_len = 0;
+  for (size_t i = 0; i < count; i++) {
+    text_len += runs[i].len;
+  }
+  size_t buf_idx = window_renderer->command_buf_idx;
+  DrawTextRunsCommand *cmd = push_command(window_renderer, DRAW_TEXT_RUNS,
+    sizeof(DrawTextRunsCommand) + sizeof(TextRun) * count + text_len);
+  if (!cmd) return x;
+  cmd->run_capacity = count;
+  char *text = (char*) (cmd->runs + count);
+
+  /* measure the runs, stop after the first one crossing the clip's right edge */
+  double start_x = x;
+  int clip_x2 = cache->last_clip_rect.x + cache->last_clip_rect.width;
+  int x1 = 0, height = 0;
+  size_t offset = 0;
+  for (size_t i = 0; i < count && x <= clip_x2; i++) {
+    if (runs[i].len == 0) continue;
+    int x_offset;
+    RenTab tab = { .offset = x - start_x };
+    double width = ren_font_group_get_width(runs[i].fonts, runs[i].text, runs[i].len, tab, &x_offset);
+    TextRun *run = &cmd->runs[cmd->run_count++];
+    memcpy(run->fonts, runs[i].fonts, sizeof(RenFont*) * FONT_FALLBACK_MAX);
+    run->color = runs[i].color;
+    run->x = x;
+    run->offset = offset;
+    run->len = runs[i].len;
+    run->tab_size = ren_font_group_get_tab_size(runs[i].fonts);
+    run->tab = tab;
+    memcpy(text + offset, runs[i].text, runs[i].len);
+    offset += runs[i].len;
+    if (cmd->run_count == 1) x1 = x + x_offset;
+    height = rencache_max(height, ren_font_group_get_height(runs[i].fonts));
+    x += width;
+  }
+
+  cmd->rect = (RenRect) { x1, y, (int)x - x1, height };
+  if (cmd->run_count == 0 || !rects_overlap(cache->last_clip_rect, cmd->rect)) {
+    /* nothing visible: drop the command */
+    window_renderer->command_buf_idx = buf_idx;
+    return x;
+  }
+  /* the unused runs are left out, the text is hashed after the runs */
+  seal_command(cmd, offsetof(DrawTextRunsCommand, runs) + sizeof(TextRun) * cmd->run_count);
+  Command *header = (Command*) ((char*) cmd - COMMAND_BARE_SIZE);
+  header->hash = hash(text, offset, header->hash);
+  return x;
+}
+
+
+void rencache_scroll_rect(RenWindow *window_renderer, RenRect rect, int dy) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache || dy == 0 || cache->scroll_count == MAX_SCROLL_RECTS) return;
+  for (int i = 0; i < cache->scroll_count; i++) {
+    /* don't move the same pixels twice */
+    RenRect r = intersect_rects(cache->scrolls[i].rect, rect);
+    if (r.width > 0 && r.height > 0) return;
+  }
+  cache->scrolls[cache->scroll_count++] = (ScrollRect) { rect, dy };
+}
+
+
+RenLayer* rencache_layer_new(void) {
+  return SDL_calloc(1, sizeof(RenLayer));
+}
+
+
+void rencache_layer_free(RenLayer *layer) {
+  if (layer) {
+    SDL_free(layer->commands);
+    SDL_free(layer);
+  }
+}
+
+
+void rencache_layer_invalidate(RenLayer *layer) {
+  layer->valid = false;
+}
+
+
+void rencache_begin_layer(RenWindow *window_renderer, RenLayer *layer) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache) return;
+  layer->start = window_renderer->command_buf_idx;
+  layer->clip = cache->last_clip_rect;
+  layer->recording = true;
+}
+
+
+void rencache_end_layer(RenWindow *window_renderer, RenLayer *layer) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache || !layer->recording) return;
+  layer->recording = false;
+  layer->valid = false;
+  /* commands may have been dropped */
+  if (cache->resize_issue) return;
+  size_t size = window_renderer->command_buf_idx - layer->start;
+  if (size > layer->capacity) {
+    uint8_t *commands = SDL_realloc(layer->commands, size);
+    if (!commands) return;
+    layer->commands = commands;
+    layer->capacity = size;
+  }
+  if (size > 0) {
+    memcpy(layer->commands, window_renderer->command_buf + layer->start, size);
+  }
+  layer->size = size;
+  layer->end_clip = cache->last_clip_rect;
+  layer->font_generation = ren_font_get_generation();
+  layer->valid = true;
+}
+
+
+/* replays the commands of a layer, the hashes are copied along so nothing
+** but the cells is computed again. Returns false if the layer can't be
+** replayed and must be recorded again */
+bool rencache_draw_layer(RenWindow *window_renderer, RenLayer *layer) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache || !layer->valid || cache->resize_issue) return false;
+  /* commands outside of the clip were never recorded, and fonts may be gone */
+  RenRect clip = cache->last_clip_rect;
+  if (clip.x != layer->clip.x || clip.y != layer->clip.y
+   || clip.width != layer->clip.width || clip.height != layer->clip.height
+   || layer->font_generation != ren_font_get_generation()) {
+    return false;
+  }
+  while (window_renderer->command_buf_idx + layer->size > window_renderer->command_buf_size) {
+    if (!expand_command_buffer(window_renderer)) return false;
+  }
+  if (layer->size > 0) {
+    memcpy(window_renderer->command_buf + window_renderer->command_buf_idx, layer->commands, layer->size);
+    window_renderer->command_buf_idx += layer->size;
+  }
+  cache->last_clip_rect = layer->end_clip;
+  return true;
+}
+
+
 void rencache_invalidate(RenWindow *window_renderer) {
   RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
   if (cache) {
-    memset(cache->cells_prev, 0xff, sizeof(cache->cells_buf1));
+    cache->prev_valid = false;
+  }
+  if (cache && cache->cells_prev) {
+    memset(cache->cells_prev, 0xff, sizeof(uint64_t) * cache->cells_x * cache->cells_y);
   }
 }
 
@@ -260,71 +676,558 @@ void rencache_begin_frame(RenWindow *window_renderer) {
   int w, h;
   cache->resize_issue = false;
   ren_get_size(window_renderer, &w, &h);
-  if (cache->screen_rect.width != w || h != cache->screen_rect.height) {
+  if (cache->screen_rect.width != w || h != cache->screen_rect.height || !cache->cells) {
     cache->screen_rect.width = w;
     cache->screen_rect.height = h;
+    if (!resize_grid(cache, w, h)) {
+      fprintf(stderr, "Warning: (" __FILE__ "): unable to allocate the cell grid (%dx%d)\n", w, h);
+    }
     rencache_invalidate(window_renderer);
   }
   cache->last_clip_rect = cache->screen_rect;
+  cache->scroll_count = 0;
+}
+
+
+static void push_bin(RenCacheState *cache, int idx, const BinEntry *entry) {
+  if (cache->bin_count == cache->bin_capacity) {
+    size_t capacity = cache->bin_capacity ? cache->bin_capacity * 2 : 4096;
+    BinPair *pairs = SDL_realloc(cache->bin_pairs, capacity * sizeof(BinPair));
+    if (!pairs) {
+      /* fall back to replaying every command */
+      cache->bins_valid = false;
+      return;
+    }
+    cache->bin_pairs = pairs;
+    cache->bin_capacity = capacity;
+  }
+  cache->bin_pairs[cache->bin_count++] = (BinPair) { idx, *entry };
 }
 
 
-static void update_overlapping_cells(RenCacheState *cache, RenRect r, unsigned h) {
-  int x1 = r.x / CELL_SIZE;
-  int y1 = r.y / CELL_SIZE;
-  int x2 = (r.x + r.width) / CELL_SIZE;
-  int y2 = (r.y + r.height) / CELL_SIZE;
+/* vertical position of a command in a row of cells, relative to the row so
+** that a command moved by a scroll hashes the same in the row it moved to */
+static inline uint64_t row_key(RenCacheState *cache, const Command *cmd, RenRect r, int dy, int row) {
+  int top = row * cache->cell_size;
+  if (cmd->type == DRAW_TEXT || cmd->type == DRAW_TEXT_RUNS) {
+    /* glyphs are placed from the top of the text */
+    return (uint32_t) (cmd->command[0].y + dy - top);
+  }
+  /* clips and rects only matter by the part of the row they cover */
+  int y1 = rencache_max(r.y, top) - top;
+  int y2 = rencache_min(r.y + r.height, top + cache->cell_size) - top;
+  return ((uint64_t) (uint32_t) y1 << 32) | (uint32_t) y2;
+}
+
+
+/* mixes a command moved by dy into the cells overlapped by r, limited to
+** the cells of `bounds` if given, and bins it with `entry` if given */
+static void update_overlapping_cells(RenCacheState *cache, uint64_t *cells, const Command *cmd, RenRect r, int dy, const RenRect *bounds, const BinEntry *entry) {
+  int x1, y1, x2, y2;
+  cell_range(cache, r, &x1, &y1, &x2, &y2);
+  if (bounds) {
+    x1 = rencache_max(x1, bounds->x);
+    y1 = rencache_max(y1, bounds->y);
+    x2 = rencache_min(x2, bounds->x + bounds->width - 1);
+    y2 = rencache_min(y2, bounds->y + bounds->height - 1);
+  }
 
   for (int y = y1; y <= y2; y++) {
+    uint64_t h = cmd->hash ^ (row_key(cache, cmd, r, dy, y) * PRIME64_2);
     for (int x = x1; x <= x2; x++) {
-      int idx = cell_idx(x, y);
-      hash(&cache->cells[idx], &h, sizeof(h));
+      int idx = cell_idx(cache, x, y);
+      hash_cell(&cells[idx], h);
+      if (entry && cache->bins_valid) {
+        push_bin(cache, idx, entry);
+      }
     }
   }
 }
 
 
-static void push_rect(RenCacheState *cache, RenRect r, int *count) {
-  /* try to merge with existing rectangle */
+/* sorts the binned commands by cell, keeping the command order within a cell */
+static void build_bins(RenCacheState *cache) {
+  if (!cache->bins_valid) { return; }
+  if (cache->bin_entries_capacity < cache->bin_count) {
+    BinEntry *entries = SDL_realloc(cache->bin_entries, cache->bin_capacity * sizeof(BinEntry));
+    if (!entries) {
+      cache->bins_valid = false;
+      return;
+    }
+    cache->bin_entries = entries;
+    cache->bin_entries_capacity = cache->bin_capacity;
+  }
+  int cell_count = cache->cells_x * cache->cells_y;
+  memset(cache->bin_start, 0, sizeof(unsigned) * (cell_count + 1));
+  for (size_t i = 0; i < cache->bin_count; i++) {
+    cache->bin_start[cache->bin_pairs[i].cell + 1]++;
+  }
+  for (int i = 0; i < cell_count; i++) {
+    cache->bin_start[i + 1] += cache->bin_start[i];
+  }
+  /* bin_start[idx] is used as the insertion point of each cell, and ends up
+  ** at the start of the next cell: shift it back afterwards */
+  for (size_t i = 0; i < cache->bin_count; i++) {
+    cache->bin_entries[cache->bin_start[cache->bin_pairs[i].cell]++] = cache->bin_pairs[i].entry;
+  }
+  memmove(cache->bin_start + 1, cache->bin_start, sizeof(unsigned) * cell_count);
+  cache->bin_start[0] = 0;
+}
+
+
+static int compare_entries(const void *a, const void *b) {
+  uint32_t ca = ((const BinEntry*)a)->command, cb = ((const BinEntry*)b)->command;
+  return ca < cb ? -1 : ca > cb;
+}
+
+
+/* collects the commands binned in the cells overlapping r, in command order */
+static bool gather_commands(RenCacheState *cache, RenRect r, CommandList *list) {
+  int x1, y1, x2, y2;
+  cell_range(cache, r, &x1, &y1, &x2, &y2);
+
+  /* large rects gather most commands many times over, walking the
+  ** command buffer is cheaper then */
+  size_t total = 0;
+  for (int y = y1; y <= y2; y++) {
+    total += cache->bin_start[cell_idx(cache, x2, y) + 1] - cache->bin_start[cell_idx(cache, x1, y)];
+  }
+  if (total > cache->command_count) { return false; }
+
+  list->count = 0;
+  for (int y = y1; y <= y2; y++) {
+    for (int x = x1; x <= x2; x++) {
+      int idx = cell_idx(cache, x, y);
+      size_t count = cache->bin_start[idx + 1] - cache->bin_start[idx];
+      if (list->count + count > list->capacity) {
+        size_t capacity = rencache_max(list->capacity * 2, list->count + count);
+        BinEntry *entries = SDL_realloc(list->entries, capacity * sizeof(BinEntry));
+        if (!entries) { return false; }
+        list->entries = entries;
+        list->capacity = capacity;
+      }
+      memcpy(list->entries + list->count, cache->bin_entries + cache->bin_start[idx], count * sizeof(BinEntry));
+      list->count += count;
+    }
+  }
+
+  /* commands spanning several cells are gathered once per cell */
+  qsort(list->entries, list->count, sizeof(BinEntry), compare_entries);
+  size_t n = 0;
+  for (size_t i = 0; i < list->count; i++) {
+    if (n == 0 || list->entries[n - 1].command != list->entries[i].command) {
+      list->entries[n++] = list->entries[i];
+    }
+  }
+  list->count = n;
+  return true;
+}
+
+
+static bool overlaps_any(RenRect r, RenRect *rects, int count) {
+  for (int i = 0; i < count; i++) {
+    RenRect over = intersect_rects(r, rects[i]);
+    if (over.width > 0 && over.height > 0) { return true; }
+  }
+  return false;
+}
+
+static void push_rect(RenCacheState *cache, RenRect r, int *count, RenRect *scrolled, int scroll_count) {
+  /* try to merge with existing rectangle; over a scrolled region only as long
+  ** as no clean cell is added, its edges would otherwise merge into all of it */
   for (int i = *count - 1; i >= 0; i--) {
     RenRect *rp = &cache->rect_buf[i];
     if (rects_overlap(*rp, r)) {
-      *rp = merge_rects(*rp, r);
-      return;
+      RenRect merged = merge_rects(*rp, r);
+      bool exact = merged.width * merged.height == rp->width * rp->height + r.width * r.height;
+      if (exact || !overlaps_any(merged, scrolled, scroll_count)) {
+        *rp = merged;
+        return;
+      }
     }
   }
   /* couldn't merge with previous rectangle: push */
   cache->rect_buf[(*count)++] = r;
 }
 
+static void push_deferred_rect(RenCacheState *cache, RenRect r) {
+  if (r.width == 0 || r.height == 0) { return; }
+  if (cache->deferred_count == MAX_DEFERRED_RECTS) {
+    RenRect *last = &cache->deferred[MAX_DEFERRED_RECTS - 1];
+    *last = merge_rects(*last, r);
+    return;
+  }
+  cache->deferred[cache->deferred_count++] = r;
+}
+
+
+static void set_surface_clip(RenSurface *rs, RenRect r) {
+  SDL_SetSurfaceClipRect(rs->surface, &(SDL_Rect){ r.x * rs->scale, r.y * rs->scale, r.width * rs->scale, r.height * rs->scale });
+}
+
+
+static void draw_command(RenSurface *rs, Command *cmd, RenRect r) {
+  SetClipCommand *ccmd = (SetClipCommand*)&cmd->command;
+  DrawRectCommand *rcmd = (DrawRectCommand*)&cmd->command;
+  DrawTextCommand *tcmd = (DrawTextCommand*)&cmd->command;
+  DrawTextRunsCommand *trcmd = (DrawTextRunsCommand*)&cmd->command;
+  switch (cmd->type) {
+    case SET_CLIP:
+      set_surface_clip(rs, intersect_rects(ccmd->rect, r));
+      break;
+    case DRAW_RECT:
+      ren_draw_rect(rs, rcmd->rect, rcmd->color);
+      break;
+    case DRAW_TEXT:
+      ren_draw_text(rs, tcmd->fonts, tcmd->text, tcmd->len, tcmd->text_x, tcmd->rect.y, tcmd->color, tcmd->tab, tcmd->tab_size);
+      break;
+    case DRAW_TEXT_RUNS: {
+      const char *text = (const char*) (trcmd->runs + trcmd->run_capacity);
+      for (size_t j = 0; j < trcmd->run_count; j++) {
+        TextRun *run = &trcmd->runs[j];
+        ren_draw_text(rs, run->fonts, text + run->offset, run->len, run->x, trcmd->rect.y, run->color, run->tab, run->tab_size);
+      }
+      break;
+    }
+  }
+}
+
+
+/* replays the commands overlapping r, the clip of rs must already be set to r */
+static void draw_commands(RenWindow *window_renderer, RenSurface *rs, RenRect r, CommandList *list) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  if (!cache->bins_valid || !gather_commands(cache, r, list)) {
+    Command *cmd = NULL;
+    while (next_command(window_renderer, &cmd)) {
+      if (cmd->type != SET_CLIP && !rects_overlap(cmd->command[0], r)) { continue; }
+      draw_command(rs, cmd, r);
+    }
+    return;
+  }
+
+  uint32_t clip = NO_CLIP;
+  for (size_t i = 0; i < list->count; i++) {
+    BinEntry *entry = &list->entries[i];
+    Command *cmd = (Command*) (window_renderer->command_buf + entry->command);
+    if (!rects_overlap(cmd->command[0], r)) { continue; }
+    if (entry->clip != clip) {
+      clip = entry->clip;
+      if (clip == NO_CLIP) {
+        set_surface_clip(rs, r);
+      } else {
+        draw_command(rs, (Command*) (window_renderer->command_buf + clip), r);
+      }
+    }
+    draw_command(rs, cmd, r);
+  }
+}
+
+
+static void draw_band(RenWorkerPool *pool, RenWorker *worker) {
+  RenCacheState *cache = (RenCacheState*)pool->window->cache_state;
+  RenSurface rs = { worker->surface, pool->rs.scale };
+  for (int i = 0; i < pool->rect_count; i++) {
+    RenRect r = intersect_rects(cache->rect_buf[i], worker->band);
+    if (r.width == 0 || r.height == 0) { continue; }
+    set_surface_clip(&rs, r);
+    draw_commands(pool->window, &rs, r, &worker->commands);
+  }
+}
+
+
+static int worker_main(void *data) {
+  RenWorker *worker = data;
+  RenWorkerPool *pool = worker->pool;
+  /* the first frame may have been started before this thread runs */
+  unsigned generation = 0;
+  SDL_LockMutex(pool->lock);
+  for (;;) {
+    while (!pool->quit && pool->generation == generation) {
+      SDL_WaitCondition(pool->start, pool->lock);
+    }
+    if (pool->quit) { break; }
+    generation = pool->generation;
+    SDL_UnlockMutex(pool->lock);
+
+    draw_band(pool, worker);
+
+    SDL_LockMutex(pool->lock);
+    if (--pool->pending == 0) {
+      SDL_SignalCondition(pool->done);
+    }
+  }
+  SDL_UnlockMutex(pool->lock);
+  return 0;
+}
+
+
+static RenWorkerPool* pool_create(void) {
+  int worker_count = rencache_min(SDL_GetNumLogicalCPUCores() - 1, MAX_WORKERS);
+  if (worker_count <= 0) { return NULL; }
+  RenWorkerPool *pool = SDL_calloc(1, sizeof(RenWorkerPool));
+  if (!pool) { return NULL; }
+  pool->lock = SDL_CreateMutex();
+  pool->start = SDL_CreateCondition();
+  pool->done = SDL_CreateCondition();
+  if (!pool->lock || !pool->start || !pool->done) {
+    pool_free(pool);
+    return NULL;
+  }
+  for (int i = 0; i <= worker_count; i++) {
+    pool->workers[i].pool = pool;
+  }
+  for (int i = 1; i <= worker_count; i++) {
+    pool->workers[i].thread = SDL_CreateThread(worker_main, "rencache", &pool->workers[i]);
+    if (!pool->workers[i].thread) { break; }
+    pool->worker_count = i;
+  }
+  if (pool->worker_count == 0) {
+    pool_free(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+
+static void pool_free(RenWorkerPool *pool) {
+  if (!pool) { return; }
+  if (pool->lock) {
+    SDL_LockMutex(pool->lock);
+    pool->quit = true;
+    SDL_BroadcastCondition(pool->start);
+    SDL_UnlockMutex(pool->lock);
+  }
+  for (int i = 0; i <= MAX_WORKERS; i++) {
+    if (pool->workers[i].thread) {
+      SDL_WaitThread(pool->workers[i].thread, NULL);
+    }
+    SDL_DestroySurface(pool->workers[i].surface);
+    SDL_free(pool->workers[i].commands.entries);
+  }
+  SDL_DestroyCondition(pool->start);
+  SDL_DestroyCondition(pool->done);
+  SDL_DestroyMutex(pool->lock);
+  SDL_free(pool);
+}
+
+
+/* points the surface of a worker at the pixels of the window surface */
+static bool worker_set_surface(RenWorker *worker, SDL_Surface *target) {
+  SDL_Surface *surface = worker->surface;
+  if (surface && surface->pixels == target->pixels && surface->w == target->w
+      && surface->h == target->h && surface->pitch == target->pitch
+      && surface->format == target->format) {
+    return true;
+  }
+  SDL_DestroySurface(surface);
+  worker->surface = SDL_CreateSurfaceFrom(target->w, target->h, target->format, target->pixels, target->pitch);
+  return worker->surface != NULL;
+}
+
+
+/* rasterizes the dirty rects in horizontal bands, one per thread. Returns
+** false if the redraw is too small to be split, or the workers are unavailable */
+static bool draw_parallel(RenWindow *window_renderer, RenSurface rs, int rect_count) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  int area = 0, y1 = INT32_MAX, y2 = 0;
+  for (int i = 0; i < rect_count; i++) {
+    RenRect r = cache->rect_buf[i];
+    area += r.width * r.height;
+    y1 = rencache_min(y1, r.y);
+    y2 = rencache_max(y2, r.y + r.height);
+  }
+  if (area * rs.scale * rs.scale < PARALLEL_MIN_AREA || y2 - y1 < 2 * MIN_BAND_HEIGHT) {
+    return false;
+  }
+  if (!cache->pool && !(cache->pool = pool_create())) {
+    return false;
+  }
+
+  RenWorkerPool *pool = cache->pool;
+  int band_count = rencache_min(pool->worker_count + 1, (y2 - y1) / MIN_BAND_HEIGHT);
+  int band_height = (y2 - y1 + band_count - 1) / band_count;
+  for (int i = 0; i <= pool->worker_count; i++) {
+    RenWorker *worker = &pool->workers[i];
+    if (!worker_set_surface(worker, rs.surface)) {
+      return false;
+    }
+    int y = rencache_min(y1 + i * band_height, y2);
+    worker->band = (RenRect) { cache->screen_rect.x, y, cache->screen_rect.width, rencache_min(band_height, y2 - y) };
+  }
+
+  /* glyphs are loaded lazily by the font code, which is not thread safe:
+  ** load every glyph the workers are going to draw beforehand */
+  Command *cmd = NULL;
+  while (next_command(window_renderer, &cmd)) {
+    if (cmd->type != DRAW_TEXT && cmd->type != DRAW_TEXT_RUNS) { continue; }
+    bool visible = false;
+    for (int i = 0; i < rect_count && !visible; i++) {
+      visible = rects_overlap(cache->rect_buf[i], cmd->command[0]);
+    }
+    if (!visible) { continue; }
+    unsigned deferrals = ren_font_get_glyph_deferrals();
+    if (cmd->type == DRAW_TEXT) {
+      DrawTextCommand *tcmd = (DrawTextCommand*)&cmd->command;
+      ren_font_group_prewarm(tcmd->fonts, tcmd->text, tcmd->len);
+    } else {
+      DrawTextRunsCommand *trcmd = (DrawTextRunsCommand*)&cmd->command;
+      const char *text = (const char*) (trcmd->runs + trcmd->run_capacity);
+      for (size_t j = 0; j < trcmd->run_count; j++) {
+        ren_font_group_prewarm(trcmd->runs[j].fonts, text + trcmd->runs[j].offset, trcmd->runs[j].len);
+      }
+    }
+    /* the workers draw placeholders for the glyphs that couldn't be loaded */
+    if (ren_font_get_glyph_deferrals() != deferrals) {
+      push_deferred_rect(cache, intersect_rects(cmd->command[0], cache->screen_rect));
+    }
+  }
+
+  ren_font_lock_glyphs(true);
+  SDL_LockMutex(pool->lock);
+  pool->window = window_renderer;
+  pool->rs = rs;
+  pool->rect_count = rect_count;
+  pool->pending = pool->worker_count;
+  pool->generation++;
+  SDL_BroadcastCondition(pool->start);
+  SDL_UnlockMutex(pool->lock);
+
+  draw_band(pool, &pool->workers[0]);
+
+  SDL_LockMutex(pool->lock);
+  while (pool->pending > 0) {
+    SDL_WaitCondition(pool->done, pool->lock);
+  }
+  SDL_UnlockMutex(pool->lock);
+  ren_font_lock_glyphs(false);
+  return true;
+}
+
+
+/* moves the rows of rect by dy, rect must lie within the surface once moved */
+static void scroll_surface(RenSurface *rs, RenRect rect, int dy) {
+  SDL_Surface *surface = rs->surface;
+  int bpp = SDL_BYTESPERPIXEL(surface->format);
+  int x = rect.x * rs->scale, y = rect.y * rs->scale;
+  int height = rect.height * rs->scale, offset = dy * rs->scale;
+  size_t row_size = (size_t) rect.width * rs->scale * bpp;
+  uint8_t *pixels = (uint8_t*) surface->pixels + x * bpp;
+  /* copy the rows in the order they are moved to, so that none is overwritten first */
+  for (int i = 0; i < height; i++) {
+    int row = y + (dy > 0 ? height - 1 - i : i);
+    memmove(pixels + row * surface->pitch, pixels + (row - offset) * surface->pitch, row_size);
+  }
+}
+
+
+/* moves the pixels of a scrolled region, then gives the cells now fully covered
+** by moved pixels the hashes of the previous frame's commands moved by dy. The
+** other cells of the region are redrawn. Returns the region of moved pixels */
+static RenRect apply_scroll(RenWindow *window_renderer, RenSurface *rs, const ScrollRect *scroll) {
+  RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
+  RenRect rect = intersect_rects(scroll->rect, cache->screen_rect);
+  int dy = scroll->dy;
+  RenRect moved = intersect_rects(rect, (RenRect) { rect.x, rect.y + dy, rect.width, rect.height });
+  if (moved.width == 0 || moved.height == 0) { return moved; }
+  scroll_surface(rs, moved, dy);
+
+  /* cells fully covered by moved, the last ones may be cut by the screen edge */
+  int cs = cache->cell_size;
+  int x2 = moved.x + moved.width, y2 = moved.y + moved.height;
+  RenRect inner;
+  inner.x = (moved.x + cs - 1) / cs;
+  inner.y = (moved.y + cs - 1) / cs;
+  inner.width = (x2 == cache->screen_rect.width ? cache->cells_x : x2 / cs) - inner.x;
+  inner.height = (y2 == cache->screen_rect.height ? cache->cells_y : y2 / cs) - inner.y;
+
+  for (int y = rect.y / cs; y <= (rect.y + rect.height - 1) / cs; y++) {
+    for (int x = rect.x / cs; x <= (rect.x + rect.width - 1) / cs; x++) {
+      bool inside = x >= inner.x && x < inner.x + inner.width
+                 && y >= inner.y && y < inner.y + inner.height;
+      cache->cells_prev[cell_idx(cache, x, y)] = inside ? HASH_INITIAL : UINT64_MAX;
+    }
+  }
+  if (inner.width <= 0 || inner.height <= 0) { return moved; }
+
+  /* hash the previous frame as moved, the same way as in rencache_end_frame */
+  RenRect cr = cache->screen_rect;
+  cr.y += dy;
+  size_t offset = 0;
+  while (offset < cache->prev_command_buf_idx) {
+    Command *cmd = (Command*) (cache->prev_command_buf + offset);
+    offset += cmd->size;
+    RenRect r = cmd->command[0];
+    r.y += dy;
+    if (cmd->type == SET_CLIP) { cr = r; }
+    r = intersect_rects(r, cr);
+    if (r.width == 0 || r.height == 0) { continue; }
+    update_overlapping_cells(cache, cache->cells_prev, cmd, r, dy, &inner, NULL);
+  }
+  return moved;
+}
+
 
 void rencache_end_frame(RenWindow *window_renderer) {
   RenCacheState *cache = (RenCacheState*)window_renderer->cache_state;
   if (!cache) return;
 
-  /* update cells from commands */
+  if (!cache->cells) {
+    /* the grid could not be allocated: redraw everything */
+    RenSurface rs = renwin_get_surface(window_renderer);
+    cache->bins_valid = false;
+    ren_set_clip_rect(window_renderer, cache->screen_rect);
+    draw_commands(window_renderer, &rs, cache->screen_rect, &cache->commands);
+    ren_update_rects(window_renderer, &cache->screen_rect, 1);
+    window_renderer->command_buf_idx = 0;
+    cache->prev_valid = false;
+    return;
+  }
+
+  /* update cells from commands, and bin the drawing commands by cell */
   Command *cmd = NULL;
   RenRect cr = cache->screen_rect;
+  uint32_t clip = NO_CLIP;
+  cache->bin_count = 0;
+  cache->command_count = 0;
+  cache->bins_valid = true;
   while (next_command(window_renderer, &cmd)) {
+    uint32_t offset = (uint8_t*) cmd - window_renderer->command_buf;
+    cache->command_count++;
     /* cmd->command[0] should always be the Command rect */
-    if (cmd->type == SET_CLIP) { cr = cmd->command[0]; }
+    if (cmd->type == SET_CLIP) { cr = cmd->command[0]; clip = offset; }
     RenRect r = intersect_rects(cmd->command[0], cr);
     if (r.width == 0 || r.height == 0) { continue; }
-    unsigned h = HASH_INITIAL;
-    hash(&h, cmd, cmd->size);
-    update_overlapping_cells(cache, r, h);
+    update_overlapping_cells(cache, cache->cells, cmd, r, 0, NULL, cmd->type == SET_CLIP ? NULL : &(BinEntry) { offset, clip });
+  }
+  build_bins(cache);
+
+  /* move the scrolled regions, before comparing their cells */
+  RenSurface rs = renwin_get_surface(window_renderer);
+  RenRect scrolled[MAX_SCROLL_RECTS];
+  int scroll_count = 0;
+  for (int i = 0; i < cache->scroll_count && cache->prev_valid; i++) {
+    RenRect moved = apply_scroll(window_renderer, &rs, &cache->scrolls[i]);
+    if (moved.width > 0 && moved.height > 0) {
+      scrolled[scroll_count++] = moved;
+    }
+  }
+
+  /* the cells of the scrolled regions, where rects are merged exactly */
+  RenRect scrolled_cells[MAX_SCROLL_RECTS];
+  for (int i = 0; i < scroll_count; i++) {
+    int x1, y1, x2, y2;
+    cell_range(cache, scrolled[i], &x1, &y1, &x2, &y2);
+    scrolled_cells[i] = (RenRect) { x1, y1, x2 - x1 + 1, y2 - y1 + 1 };
   }
 
   /* push rects for all cells changed from last frame, reset cells */
   int rect_count = 0;
-  int max_x = cache->screen_rect.width / CELL_SIZE + 1;
-  int max_y = cache->screen_rect.height / CELL_SIZE + 1;
-  for (int y = 0; y < max_y; y++) {
-    for (int x = 0; x < max_x; x++) {
+  for (int y = 0; y < cache->cells_y; y++) {
+    for (int x = 0; x < cache->cells_x; x++) {
       /* compare previous and current cell for change */
-      int idx = cell_idx(x, y);
+      int idx = cell_idx(cache, x, y);
       if (cache->cells[idx] != cache->cells_prev[idx]) {
-        push_rect(cache, (RenRect) { x, y, 1, 1 }, &rect_count);
+        push_rect(cache, (RenRect) { x, y, 1, 1 }, &rect_count, scrolled_cells, scroll_count);
       }
       cache->cells_prev[idx] = HASH_INITIAL;
     }
@@ -333,54 +1236,67 @@ void rencache_end_frame(RenWindow *window_renderer) {
   /* expand rects from cells to pixels */
   for (int i = 0; i < rect_count; i++) {
     RenRect *r = &cache->rect_buf[i];
-    r->x *= CELL_SIZE;
-    r->y *= CELL_SIZE;
-    r->width *= CELL_SIZE;
-    r->height *= CELL_SIZE;
+    r->x *= cache->cell_size;
+    r->y *= cache->cell_size;
+    r->width *= cache->cell_size;
+    r->height *= cache->cell_size;
     *r = intersect_rects(*r, cache->screen_rect);
   }
 
-  RenSurface rs = renwin_get_surface(window_renderer);
   /* redraw updated regions */
-  for (int i = 0; i < rect_count; i++) {
-    /* draw */
-    RenRect r = cache->rect_buf[i];
-    ren_set_clip_rect(window_renderer, r);
-
-    cmd = NULL;
-    while (next_command(window_renderer, &cmd)) {
-      SetClipCommand *ccmd = (SetClipCommand*)&cmd->command;
-      DrawRectCommand *rcmd = (DrawRectCommand*)&cmd->command;
-      DrawTextCommand *tcmd = (DrawTextCommand*)&cmd->command;
-      switch (cmd->type) {
-        case SET_CLIP:
-          ren_set_clip_rect(window_renderer, intersect_rects(ccmd->rect, r));
-          break;
-        case DRAW_RECT:
-          ren_draw_rect(&rs, rcmd->rect, rcmd->color);
-          break;
-        case DRAW_TEXT:
-          ren_font_group_set_tab_size(tcmd->fonts, tcmd->tab_size);
-          ren_draw_text(&rs, tcmd->fonts, tcmd->text, tcmd->len, tcmd->text_x, tcmd->rect.y, tcmd->color, tcmd->tab);
-          break;
+  cache->deferred_count = 0;
+  if (!draw_parallel(window_renderer, rs, rect_count)) {
+    for (int i = 0; i < rect_count; i++) {
+      unsigned deferrals = ren_font_get_glyph_deferrals();
+      ren_set_clip_rect(window_renderer, cache->rect_buf[i]);
+      draw_commands(window_renderer, &rs, cache->rect_buf[i], &cache->commands);
+      if (ren_font_get_glyph_deferrals() != deferrals) {
+        push_deferred_rect(cache, cache->rect_buf[i]);
       }
     }
+  }
 
-    if (show_debug) {
+  if (show_debug) {
+    for (int i = 0; i < rect_count; i++) {
       RenColor color = { rand(), rand(), rand(), 50 };
-      ren_draw_rect(&rs, r, color);
+      ren_set_clip_rect(window_renderer, cache->rect_buf[i]);
+      ren_draw_rect(&rs, cache->rect_buf[i], color);
     }
   }
 
-  /* update dirty rects */
-  if (rect_count > 0) {
-    ren_update_rects(window_renderer, cache->rect_buf, rect_count);
+  /* update dirty rects and moved regions */
+  for (int i = 0; i < scroll_count; i++) {
+    cache->rect_buf[rect_count + i] = scrolled[i];
+  }
+  if (rect_count + scroll_count > 0) {
+    ren_update_rects(window_renderer, cache->rect_buf, rect_count + scroll_count);
   }
 
   /* swap cell buffer and reset */
-  unsigned *tmp = cache->cells;
+  uint64_t *tmp = cache->cells;
   cache->cells = cache->cells_prev;
   cache->cells_prev = tmp;
+
+  /* the cells drawn with placeholders differ from the next frame's */
+  for (int i = 0; i < cache->deferred_count; i++) {
+    int x1, y1, x2, y2;
+    cell_range(cache, cache->deferred[i], &x1, &y1, &x2, &y2);
+    for (int y = y1; y <= y2; y++) {
+      for (int x = x1; x <= x2; x++) {
+        cache->cells_prev[cell_idx(cache, x, y)] = UINT64_MAX;
+      }
+    }
+  }
+
+  /* keep the commands of this frame for the scroll hints of the next one */
+  uint8_t *buf = cache->prev_command_buf;
+  size_t buf_size = cache->prev_command_buf_size;
+  cache->prev_command_buf = window_renderer->command_buf;
+  cache->prev_command_buf_idx = window_renderer->command_buf_idx;
+  cache->prev_command_buf_size = window_renderer->command_buf_size;
+  cache->prev_valid = true;
+  window_renderer->command_buf = buf;
+  window_renderer->command_buf_size = buf_size;
   window_renderer->command_buf_idx = 0;
 }
 
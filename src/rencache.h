@@ -5,13 +5,36 @@
 #include <lua.h>
 #include "renderer.h"
 
+/* a run of text drawn with a single font group and color, see
+** rencache_draw_text_runs */
+typedef struct {
+  RenFont **fonts;
+  RenColor color;
+  const char *text;
+  size_t len;
+} RenTextRun;
+
+/* commands recorded once and replayed on the next frames, see
+** rencache_begin_layer */
+typedef struct RenLayer RenLayer;
+
 void  rencache_show_debug(bool enable);
 void  rencache_init(RenWindow *window_renderer);
 void  rencache_free(RenWindow *window_renderer);
 void  rencache_set_clip_rect(RenWindow *window_renderer, RenRect rect);
+RenRect rencache_get_clip_rect(RenWindow *window_renderer);
 void  rencache_draw_rect(RenWindow *window_renderer, RenRect rect, RenColor color);
 double rencache_draw_text(RenWindow *window_renderer, RenFont **font, const char *text, size_t len, double x, int y, RenColor color, RenTab tab);
+double rencache_draw_text_runs(RenWindow *window_renderer, const RenTextRun *runs, size_t count, double x, int y);
+/* hints that the content of rect moved by dy since the previous frame */
+void  rencache_scroll_rect(RenWindow *window_renderer, RenRect rect, int dy);
 void  rencache_invalidate(RenWindow *window_renderer);
+RenLayer* rencache_layer_new(void);
+void  rencache_layer_free(RenLayer *layer);
+void  rencache_layer_invalidate(RenLayer *layer);
+void  rencache_begin_layer(RenWindow *window_renderer, RenLayer *layer);
+void  rencache_end_layer(RenWindow *window_renderer, RenLayer *layer);
+bool  rencache_draw_layer(RenWindow *window_renderer, RenLayer *layer);
 void  rencache_begin_frame(RenWindow *window_renderer);
 void  rencache_end_frame(RenWindow *window_renderer);
 
@@ -8,12 +8,31 @@
 #include FT_FREETYPE_H
 #include FT_LCD_FILTER_H
 #include FT_OUTLINE_H
-#include FT_SYSTEM_H
+#include FT_SIZES_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define RENDERER_SSE2
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define RENDERER_NEON
+#endif
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include "utfconv.h"
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
 
 #include "renderer.h"
 #include "renwindow.h"
 
-// uncomment the line below for more debugging information through printf
+// uncomment the line below for more debugging information through printf,
+// configuring with -Drenderer_debug=true also exposes the helpers to Lua
 // #define RENDERER_DEBUG
 
 static RenWindow **window_list = NULL;
@@ -22,6 +41,8 @@ static size_t window_count = 0;
 
 // draw_rect_surface is used as a 1x1 surface to simplify ren_draw_rect with blending
 static SDL_Surface *draw_rect_surface = NULL;
+// draw_rect_surface is shared, rectangles may be drawn from the rencache workers
+static SDL_Mutex *draw_rect_lock = NULL;
 static FT_Library library = NULL;
 
 #define check_alloc(P) _check_alloc(P, __FILE__, __LINE__)
@@ -50,6 +71,15 @@ static const char *const get_ft_error(FT_Error err) {
 // some padding to add to atlas surface to store more glyphs
 #define FONT_HEIGHT_OVERFLOW_PX 0
 #define FONT_WIDTH_OVERFLOW_PX 9
+// glyphs restored from a cache file larger than this many ems are rejected
+#define FONT_GLYPH_MAX_EMS 4
+// bytes of atlas surfaces a font may keep before the least recently used ones are evicted
+#define FONT_ATLAS_BUDGET (4 * 1024 * 1024)
+// time a frame may spend rasterizing glyphs, glyphs past it are drawn as placeholders
+#define FONT_RASTER_BUDGET_NS (4 * 1000 * 1000)
+// time spent on the prewarm queue after each frame, and the most glyphs it holds
+#define FONT_PREWARM_BUDGET_NS (2 * 1000 * 1000)
+#define FONT_PREWARM_MAX 8192
 
 // maximum unicode codepoint supported (https://stackoverflow.com/a/52203901)
 #define MAX_UNICODE 0x10FFFF
@@ -77,7 +107,8 @@ typedef enum {
 typedef enum {
   EGlyphNone = 0,             // glyph is not loaded
   EGlyphXAdvance = (1 << 0L), // xadvance is loaded
-  EGlyphBitmap = (1 << 1L)    // bitmap is loaded
+  EGlyphBitmap = (1 << 1L),   // bitmap is loaded
+  EGlyphNoBitmap = (1 << 2L)  // glyph has no bitmap we can draw
 } ERenGlyphFlags;
 
 // metrics for a loaded glyph
@@ -95,9 +126,17 @@ typedef struct {
   unsigned int *rows[CHARMAP_ROW];
 } CharMap;
 
+// a surface of an atlas, the surface is NULL if it was evicted
+typedef struct {
+  SDL_Surface *surface;
+  // glyph_tick when a glyph was last drawn from the surface
+  unsigned int last_used;
+  unsigned int glyphs;
+} GlyphSurface;
+
 // a bitmap atlas with a fixed width, each surface acting as a bump allocator
 typedef struct {
-  SDL_Surface **surfaces;
+  GlyphSurface *surfaces;
   unsigned int width, nsurface;
 } GlyphAtlas;
 
@@ -109,12 +148,70 @@ typedef struct {
   GlyphAtlas *atlas[EGlyphFormatSize];
   size_t natlas[EGlyphFormatSize];
   size_t bytesize;
+  // pixels of the atlas surfaces, kept under FONT_ATLAS_BUDGET
+  size_t atlas_bytes;
+  unsigned int nsurface, nglyph;
+  size_t loads, evictions;
 } GlyphMap;
 
-typedef struct RenFont {
+// a font file, opened once and shared by every font loaded from it
+typedef struct FontFile {
+  struct FontFile *next;
+  // contents of the file, mapped unless mapping is unsupported, the face reads from it
+  const uint8_t *data;
+  size_t size;
+  bool mapped;
   FT_Face face;
+  // the size object activated on the face
+  FT_Size active;
   CharMap charmap;
+  // hash of data, 0 until computed
+  uint64_t hash;
+  unsigned int refs;
+  char path[];
+} FontFile;
+
+// glyphs of a font file rasterized with the same size and options, shared by
+// the fonts using them (copies, groups and the fonts of every scale)
+typedef struct FontCache {
+  struct FontCache *next;
+  FontFile *file;
+  FT_Size size;
   GlyphMap glyphs;
+  float pixel_size;
+  ERenFontAntialiasing antialiasing;
+  ERenFontHinting hinting;
+  unsigned char style;
+  unsigned int refs;
+} FontCache;
+
+// the glyphs a font group resolved for the codepoints below GROUP_GLYPH_MAX, by pen subpixel
+// position; they save the charmap, metric and fallback lookups of the text drawn most.
+// Entries are emptied when a font is freed or resized, surfaces are only used during the tick
+// they were loaded in, as surfaces left unused for a tick may be evicted
+#define GROUP_GLYPH_MAX 0x3000
+#define GROUP_GLYPH_COL 256
+#define GROUP_GLYPH_ROW (GROUP_GLYPH_MAX / GROUP_GLYPH_COL)
+
+typedef struct {
+  struct RenFont *font;
+  GlyphMetric *metric;
+  SDL_Surface *surface;
+  unsigned int glyph_id, tick;
+  int bitmap_idx;
+} GroupGlyph;
+
+typedef struct GroupGlyphs {
+  struct GroupGlyphs *next;
+  struct RenFont *fonts[FONT_FALLBACK_MAX];
+  unsigned int generation;
+  GroupGlyph *rows[GROUP_GLYPH_ROW];
+} GroupGlyphs;
+
+typedef struct RenFont {
+  FontCache *cache;
+  // the groups this font is the first font of
+  GroupGlyphs *groups;
 #ifdef LITE_USE_SDL_RENDERER
   int scale;
 #endif
@@ -127,6 +224,67 @@ typedef struct RenFont {
   char path[];
 } RenFont;
 
+// run widths are cached in a direct-mapped table; entries from an older
+// generation are stale, the generation is bumped whenever a font is resized
+// or freed
+#define RUN_WIDTH_CACHE_SIZE 4096
+
+typedef struct {
+  uint64_t key;
+  RenFont *font;
+  unsigned int len, generation;
+  double width;
+  int x_offset;
+} RunWidth;
+
+static RunWidth run_width_cache[RUN_WIDTH_CACHE_SIZE];
+// bumped whenever a font is freed or resized, see ren_font_get_generation
+static unsigned int run_width_generation = 1;
+// bumped on every presented frame, surfaces used during the current tick are never evicted:
+// the rencache workers draw glyphs prewarmed earlier in the same frame
+static unsigned int glyph_tick = 1;
+// time spent rasterizing during the current tick, and whether a glyph was deferred for lack of time
+static Uint64 raster_ns = 0;
+static bool glyphs_deferred = false;
+static unsigned int glyph_deferrals = 0;
+// set while several threads draw, glyphs are then only looked up, see ren_font_lock_glyphs
+static bool glyphs_locked = false;
+
+static FontFile *font_files = NULL;
+static FontCache *font_caches = NULL;
+
+// glyphs to rasterize ahead of their first use, a little of the queue is drained after every frame
+typedef struct {
+  RenFont *font;
+  unsigned int codepoint;
+} PrewarmGlyph;
+
+static PrewarmGlyph *prewarm_queue = NULL;
+static size_t prewarm_head = 0, prewarm_len = 0, prewarm_capacity = 0;
+
+// rasterized glyphs are kept on disk between sessions, one file per font cache, see ren_font_save_glyph_caches
+#define GLYPH_CACHE_MAGIC 0x3143474c // "LGC1"
+#define GLYPH_CACHE_VERSION 1
+
+typedef struct {
+  uint32_t magic, version;
+  uint64_t file_hash;
+  float pixel_size;
+  uint8_t antialiasing, hinting, style, padding;
+  uint32_t count;
+} GlyphCacheHeader;
+
+// followed by the rows of the bitmap, if the glyph has one
+typedef struct {
+  uint32_t glyph_id;
+  uint8_t bitmap_idx, flags, format, padding;
+  float xadvance;
+  int32_t bitmap_left, bitmap_top;
+  uint32_t width, rows;
+} GlyphCacheRecord;
+
+static char *glyph_cache_dir = NULL;
+
 #ifdef LITE_USE_SDL_RENDERER
 void update_font_scale(RenWindow *window_renderer, RenFont **fonts) {
   if (window_renderer == NULL) return;
@@ -202,14 +360,25 @@ static unsigned int font_get_glyph_id(RenFont *font, unsigned int codepoint) {
   if (codepoint > MAX_UNICODE) return 0;
   size_t row = codepoint / CHARMAP_COL;
   size_t col = codepoint - (row * CHARMAP_COL);
-  if (!font->charmap.rows[row]) font->charmap.rows[row] = check_alloc(SDL_calloc(sizeof(unsigned int), CHARMAP_COL));
-  if (font->charmap.rows[row][col] == 0) {
-    unsigned int glyph_id = FT_Get_Char_Index(font->face, codepoint);
+  CharMap *charmap = &font->cache->file->charmap;
+  if (!charmap->rows[row]) charmap->rows[row] = check_alloc(SDL_calloc(sizeof(unsigned int), CHARMAP_COL));
+  if (charmap->rows[row][col] == 0) {
+    unsigned int glyph_id = FT_Get_Char_Index(font->cache->file->face, codepoint);
     // use -1 as a sentinel value for "glyph not available", a bit risky, but OpenType
     // uses uint16 to store glyph IDs. In theory this cannot ever be reached
-    font->charmap.rows[row][col] = glyph_id ? glyph_id : (unsigned int) -1;
+    charmap->rows[row][col] = glyph_id ? glyph_id : (unsigned int) -1;
   }
-  return font->charmap.rows[row][col] == (unsigned int) -1 ? 0 : font->charmap.rows[row][col];
+  return charmap->rows[row][col] == (unsigned int) -1 ? 0 : charmap->rows[row][col];
+}
+
+// the face of a font, with the size of the font activated; faces are shared between sizes
+static FT_Face font_get_face(RenFont *font) {
+  FontFile *file = font->cache->file;
+  if (file->active != font->cache->size) {
+    FT_Activate_Size(font->cache->size);
+    file->active = font->cache->size;
+  }
+  return file->face;
 }
 
 #define FONT_IS_SUBPIXEL(F) ((F)->antialiasing == FONT_ANTIALIASING_SUBPIXEL)
@@ -224,38 +393,88 @@ static inline SDL_PixelFormat glyphformat_to_pixelformat(ERenGlyphFormat format,
   }
 }
 
-static SDL_Surface *font_allocate_glyph_surface(RenFont *font, FT_GlyphSlot slot, int bitmap_idx, GlyphMetric *metric) {
+// frees the least recently used atlas surface that was not used during this tick,
+// the glyphs it held are rasterized again when they are drawn next
+static bool font_evict_glyph_surface(FontCache *cache) {
+  GlyphSurface *lru = NULL;
+  int lru_format = 0, lru_atlas = 0, lru_surface = 0;
+  for (int glyph_format_idx = 0; glyph_format_idx < EGlyphFormatSize; glyph_format_idx++) {
+    for (int atlas_idx = 0; atlas_idx < cache->glyphs.natlas[glyph_format_idx]; atlas_idx++) {
+      GlyphAtlas *atlas = &cache->glyphs.atlas[glyph_format_idx][atlas_idx];
+      for (int surface_idx = 0; surface_idx < atlas->nsurface; surface_idx++) {
+        GlyphSurface *s = &atlas->surfaces[surface_idx];
+        if (!s->surface || s->last_used == glyph_tick) continue;
+        if (!lru || (int) (s->last_used - lru->last_used) < 0) {
+          lru = s;
+          lru_format = glyph_format_idx; lru_atlas = atlas_idx; lru_surface = surface_idx;
+        }
+      }
+    }
+  }
+  if (!lru) return false;
+
+  for (int subpixel_idx = 0; lru->glyphs && subpixel_idx < FONT_BITMAP_COUNT(cache); subpixel_idx++) {
+    for (int glyphmap_row = 0; glyphmap_row < GLYPHMAP_ROW; glyphmap_row++) {
+      GlyphMetric *row = cache->glyphs.metrics[subpixel_idx][glyphmap_row];
+      for (unsigned int col = 0; row && col < GLYPHMAP_COL; col++) {
+        GlyphMetric *m = &row[col];
+        if ((m->flags & EGlyphBitmap) && m->format == lru_format && m->atlas_idx == lru_atlas && m->surface_idx == lru_surface) {
+          m->flags &= ~EGlyphBitmap;
+          lru->glyphs--;
+          cache->glyphs.nglyph--;
+        }
+      }
+    }
+  }
+  cache->glyphs.atlas_bytes -= (size_t) lru->surface->pitch * lru->surface->h;
+  cache->glyphs.nglyph -= lru->glyphs;
+  cache->glyphs.nsurface--;
+  cache->glyphs.evictions++;
+  SDL_DestroySurface(lru->surface);
+  *lru = (GlyphSurface) { 0 };
+  return true;
+}
+
+// the height of a glyph line in the surfaces of an atlas, which hold GLYPHS_PER_ATLAS lines
+static int font_glyph_line_height(FontCache *cache, unsigned int rows) {
+  int h = FONT_HEIGHT_OVERFLOW_PX + (double) cache->size->metrics.height / 64.0f;
+  if (h <= FONT_HEIGHT_OVERFLOW_PX) h += rows;
+  if (h <= FONT_HEIGHT_OVERFLOW_PX) h += cache->pixel_size;
+  return h;
+}
+
+static SDL_Surface *font_allocate_glyph_surface(FontCache *cache, ERenGlyphFormat glyph_format, unsigned int rows, GlyphMetric *metric) {
   // get an atlas with the correct width
-  ERenGlyphFormat glyph_format = SLOT_BITMAP_TYPE(slot->bitmap);
   int atlas_idx = -1;
-  for (int i = 0; i < font->glyphs.natlas[glyph_format]; i++) {
-    if (font->glyphs.atlas[glyph_format][i].width >= metric->x1) {
+  for (int i = 0; i < cache->glyphs.natlas[glyph_format]; i++) {
+    if (cache->glyphs.atlas[glyph_format][i].width >= metric->x1) {
       atlas_idx = i;
       break;
     }
   }
   if (atlas_idx < 0) {
-    font->glyphs.atlas[glyph_format] = check_alloc(
-      SDL_realloc(font->glyphs.atlas[glyph_format], sizeof(GlyphAtlas) * (font->glyphs.natlas[glyph_format] + 1))
+    cache->glyphs.atlas[glyph_format] = check_alloc(
+      SDL_realloc(cache->glyphs.atlas[glyph_format], sizeof(GlyphAtlas) * (cache->glyphs.natlas[glyph_format] + 1))
     );
-    font->glyphs.atlas[glyph_format][font->glyphs.natlas[glyph_format]] = (GlyphAtlas) {
+    cache->glyphs.atlas[glyph_format][cache->glyphs.natlas[glyph_format]] = (GlyphAtlas) {
       .width = metric->x1 + FONT_WIDTH_OVERFLOW_PX, .nsurface = 0,
       .surfaces = NULL,
     };
-    font->glyphs.bytesize += sizeof(GlyphAtlas);
-    atlas_idx = font->glyphs.natlas[glyph_format]++;
+    cache->glyphs.bytesize += sizeof(GlyphAtlas);
+    atlas_idx = cache->glyphs.natlas[glyph_format]++;
   }
   metric->atlas_idx = atlas_idx;
-  GlyphAtlas *atlas = &font->glyphs.atlas[glyph_format][atlas_idx];
+  GlyphAtlas *atlas = &cache->glyphs.atlas[glyph_format][atlas_idx];
   SDL_PropertiesID userdata;
 
   // find the surface with the minimum height that can fit the glyph (limited to last 100 surfaces)
   int surface_idx = -1, max_surface_idx = (int) atlas->nsurface - 100, min_waste = INT_MAX;
   for (int i = atlas->nsurface - 1; i >= 0 && i > max_surface_idx; i--) {
-    userdata = SDL_GetSurfaceProperties(atlas->surfaces[i]);
+    if (!atlas->surfaces[i].surface) continue;
+    userdata = SDL_GetSurfaceProperties(atlas->surfaces[i].surface);
     assert(SDL_HasProperty(userdata, "metric"));
     GlyphMetric *m = (GlyphMetric *) SDL_GetPointerProperty(userdata, "metric", NULL);
-    int new_min_waste = (int) atlas->surfaces[i]->h - (int) m->y1;
+    int new_min_waste = (int) atlas->surfaces[i].surface->h - (int) m->y1;
     if (new_min_waste >= metric->y1 && new_min_waste < min_waste) {
       surface_idx = i;
       min_waste = new_min_waste;
@@ -263,26 +482,43 @@ static SDL_Surface *font_allocate_glyph_surface(RenFont *font, FT_GlyphSlot slot
   }
   if (surface_idx < 0) {
     // allocate a new surface array, and a surface
-    int h = FONT_HEIGHT_OVERFLOW_PX + (double) font->face->size->metrics.height / 64.0f;
-    if (h <= FONT_HEIGHT_OVERFLOW_PX) h += slot->bitmap.rows;
-    if (h <= FONT_HEIGHT_OVERFLOW_PX) h += font->size;
+    int h = font_glyph_line_height(cache, rows);
     int depth = 0;
     SDL_PixelFormat format = glyphformat_to_pixelformat(glyph_format, &depth);
-    atlas->surfaces = check_alloc(SDL_realloc(atlas->surfaces, sizeof(SDL_Surface *) * (atlas->nsurface + 1)));
-    atlas->surfaces[atlas->nsurface] = check_alloc(SDL_CreateSurface(atlas->width, GLYPHS_PER_ATLAS * h, format));
-    userdata = SDL_GetSurfaceProperties(atlas->surfaces[atlas->nsurface]);
+    // make room for the surface, if everything was used this tick we go over budget instead
+    size_t bytes = (size_t) atlas->width * GLYPHS_PER_ATLAS * h * (depth / 8);
+    while (cache->glyphs.atlas_bytes + bytes > FONT_ATLAS_BUDGET && font_evict_glyph_surface(cache));
+    // reuse the slot of an evicted surface, glyph metrics refer to surfaces by index
+    for (int i = 0; i < atlas->nsurface && surface_idx < 0; i++) {
+      if (!atlas->surfaces[i].surface) surface_idx = i;
+    }
+    if (surface_idx < 0) {
+      atlas->surfaces = check_alloc(SDL_realloc(atlas->surfaces, sizeof(GlyphSurface) * (atlas->nsurface + 1)));
+      cache->glyphs.bytesize += sizeof(GlyphSurface);
+      surface_idx = atlas->nsurface++;
+    }
+    SDL_Surface *surface = check_alloc(SDL_CreateSurface(atlas->width, GLYPHS_PER_ATLAS * h, format));
+    atlas->surfaces[surface_idx] = (GlyphSurface) { .surface = surface, .last_used = glyph_tick, .glyphs = 0 };
+    userdata = SDL_GetSurfaceProperties(surface);
     SDL_SetPointerProperty(userdata, "metric", NULL);
-    surface_idx = atlas->nsurface++;
-    font->glyphs.bytesize += (sizeof(SDL_Surface *) + sizeof(SDL_Surface) + atlas->width * GLYPHS_PER_ATLAS * h * glyph_format);
+    cache->glyphs.atlas_bytes += (size_t) surface->pitch * surface->h;
+    cache->glyphs.nsurface++;
   }
   metric->surface_idx = surface_idx;
-  userdata = SDL_GetSurfaceProperties(atlas->surfaces[surface_idx]);
+  GlyphSurface *glyph_surface = &atlas->surfaces[surface_idx];
+  glyph_surface->last_used = glyph_tick;
+  glyph_surface->glyphs++;
+  cache->glyphs.nglyph++;
+  userdata = SDL_GetSurfaceProperties(glyph_surface->surface);
   if (SDL_HasProperty(userdata, "metric")) {
     GlyphMetric *last_metric = (GlyphMetric *) SDL_GetPointerProperty(userdata, "metric", NULL);
     metric->y0 = last_metric->y1; metric->y1 += last_metric->y1;
+  } else {
+    // the metric may be left over from a glyph evicted earlier
+    metric->y0 = 0;
   }
   SDL_SetPointerProperty(userdata, "metric", (void *) metric);
-  return atlas->surfaces[surface_idx];
+  return glyph_surface->surface;
 }
 
 static GlyphMetric *font_load_glyph_metric(RenFont *font, unsigned int glyph_id, unsigned int bitmap_idx) {
@@ -291,45 +527,47 @@ static GlyphMetric *font_load_glyph_metric(RenFont *font, unsigned int glyph_id,
   int bitmaps = FONT_BITMAP_COUNT(font);
 
   // we set all 3 subpixel bitmaps at once, so if either of them are missing we should load it with freetype
-  if (!font->glyphs.metrics[0][row] || !(font->glyphs.metrics[0][row][col].flags & EGlyphXAdvance)) {
+  if (!font->cache->glyphs.metrics[0][row] || !(font->cache->glyphs.metrics[0][row][col].flags & EGlyphXAdvance)) {
     // load the font without hinting to fix an issue with monospaced fonts,
     // because freetype doesn't report the correct LSB and RSB delta. Transformation & subpixel positioning don't affect
     // the xadvance, so we can save some time by not doing this step multiple times
-    if (FT_Load_Glyph(font->face, glyph_id, (load_option | FT_LOAD_BITMAP_METRICS_ONLY | FT_LOAD_NO_HINTING) & ~FT_LOAD_FORCE_AUTOHINT) != 0)
+    FT_Face face = font_get_face(font);
+    if (FT_Load_Glyph(face, glyph_id, (load_option | FT_LOAD_BITMAP_METRICS_ONLY | FT_LOAD_NO_HINTING) & ~FT_LOAD_FORCE_AUTOHINT) != 0)
       return NULL;
     for (int i = 0; i < bitmaps; i++) {
       // save the metrics for all subpixel indexes
-      if (!font->glyphs.metrics[i][row]) {
-        font->glyphs.metrics[i][row] = check_alloc(SDL_calloc(sizeof(GlyphMetric), GLYPHMAP_COL));
-        font->glyphs.bytesize += sizeof(GlyphMetric) * GLYPHMAP_COL;
+      if (!font->cache->glyphs.metrics[i][row]) {
+        font->cache->glyphs.metrics[i][row] = check_alloc(SDL_calloc(sizeof(GlyphMetric), GLYPHMAP_COL));
+        font->cache->glyphs.bytesize += sizeof(GlyphMetric) * GLYPHMAP_COL;
       }
-      GlyphMetric *metric = &font->glyphs.metrics[i][row][col];
+      GlyphMetric *metric = &font->cache->glyphs.metrics[i][row][col];
       metric->flags |= EGlyphXAdvance;
-      metric->xadvance = font->face->glyph->advance.x / 64.0f;
+      metric->xadvance = face->glyph->advance.x / 64.0f;
     }
   }
-  return &font->glyphs.metrics[bitmap_idx][row][col];
+  return &font->cache->glyphs.metrics[bitmap_idx][row][col];
 }
 
-static SDL_Surface *font_load_glyph_bitmap(RenFont *font, unsigned int glyph_id, unsigned int bitmap_idx) {
-  GlyphMetric *metric = font_load_glyph_metric(font, glyph_id, bitmap_idx);
-  if (!metric) return NULL;
-  if (metric->flags & EGlyphBitmap) return font->glyphs.atlas[metric->format][metric->atlas_idx].surfaces[metric->surface_idx];
-
+static SDL_Surface *font_rasterize_glyph(RenFont *font, unsigned int glyph_id, unsigned int bitmap_idx, GlyphMetric *metric) {
   // render the glyph for a bitmap_idx
   unsigned int load_option = font_set_load_options(font), render_option = font_set_render_options(font);
-  FT_GlyphSlot slot = font->face->glyph;
-  if (FT_Load_Glyph(font->face, glyph_id, load_option | FT_LOAD_BITMAP_METRICS_ONLY) != 0
+  FT_Face face = font_get_face(font);
+  FT_GlyphSlot slot = face->glyph;
+  if (FT_Load_Glyph(face, glyph_id, load_option | FT_LOAD_BITMAP_METRICS_ONLY) != 0
       || font_set_style(&slot->outline, bitmap_idx * (64 / SUBPIXEL_BITMAPS_CACHED), font->style) != 0
-      || FT_Render_Glyph(slot, render_option) != 0)
+      || FT_Render_Glyph(slot, render_option) != 0) {
+    metric->flags |= EGlyphNoBitmap;
     return NULL;
+  }
 
   // if this bitmap is empty, or has a format we don't support, just store the xadvance
   if (!slot->bitmap.width || !slot->bitmap.rows || !slot->bitmap.buffer ||
       (slot->bitmap.pixel_mode != FT_PIXEL_MODE_MONO
         && slot->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY
-        && slot->bitmap.pixel_mode != FT_PIXEL_MODE_LCD))
+        && slot->bitmap.pixel_mode != FT_PIXEL_MODE_LCD)) {
+    metric->flags |= EGlyphNoBitmap;
     return NULL;
+  }
 
   unsigned int glyph_width = slot->bitmap.width / FONT_BITMAP_COUNT(font);
   // FT_PIXEL_MODE_MONO uses 1 bit per pixel packed bitmap
@@ -339,11 +577,13 @@ static SDL_Surface *font_load_glyph_bitmap(RenFont *font, unsigned int glyph_id,
   metric->y1 = slot->bitmap.rows;
   metric->bitmap_left = slot->bitmap_left;
   metric->bitmap_top = slot->bitmap_top;
-  metric->flags |= EGlyphBitmap;
   metric->format = SLOT_BITMAP_TYPE(slot->bitmap);
 
-  // find the best surface to copy the glyph over, and copy it
-  SDL_Surface *surface = font_allocate_glyph_surface(font, slot, bitmap_idx, metric);
+  // find the best surface to copy the glyph over, and copy it; the glyph is only flagged
+  // afterwards, its stale surface index must not be matched if the allocation evicts
+  SDL_Surface *surface = font_allocate_glyph_surface(font->cache, metric->format, slot->bitmap.rows, metric);
+  metric->flags |= EGlyphBitmap;
+  font->cache->glyphs.loads++;
   uint8_t* pixels = surface->pixels;
   for (unsigned int line = 0; line < slot->bitmap.rows; ++line) {
     int target_offset = surface->pitch * (line + metric->y0); // x0 is always assumed to be 0
@@ -361,6 +601,32 @@ static SDL_Surface *font_load_glyph_bitmap(RenFont *font, unsigned int glyph_id,
   return surface;
 }
 
+static SDL_Surface *font_load_glyph_bitmap(RenFont *font, unsigned int glyph_id, unsigned int bitmap_idx) {
+  GlyphMetric *metric = font_load_glyph_metric(font, glyph_id, bitmap_idx);
+  if (!metric) return NULL;
+  if (metric->flags & EGlyphBitmap) {
+    GlyphSurface *s = &font->cache->glyphs.atlas[metric->format][metric->atlas_idx].surfaces[metric->surface_idx];
+    // only written once per tick, so the rencache workers drawing prewarmed glyphs just read it
+    if (s->last_used != glyph_tick) s->last_used = glyph_tick;
+    return s->surface;
+  }
+  if (metric->flags & EGlyphNoBitmap) return NULL;
+
+  // the rencache workers only get here for glyphs their prewarm deferred, which
+  // already reported it; nothing is written while they draw
+  if (glyphs_locked) return NULL;
+  // once the frame spent its budget the glyph is left for the next frame, and a placeholder is drawn
+  if (raster_ns >= FONT_RASTER_BUDGET_NS) {
+    glyphs_deferred = true;
+    glyph_deferrals++;
+    return NULL;
+  }
+  Uint64 start = SDL_GetTicksNS();
+  SDL_Surface *surface = font_rasterize_glyph(font, glyph_id, bitmap_idx, metric);
+  raster_ns += SDL_GetTicksNS() - start;
+  return surface;
+}
+
 // https://en.wikipedia.org/wiki/Whitespace_character
 static inline int is_whitespace(unsigned int codepoint) {
   switch (codepoint) {
@@ -369,85 +635,491 @@ static inline int is_whitespace(unsigned int codepoint) {
   return (codepoint >= 0x9 && codepoint <= 0xD) || (codepoint >= 0x2000 && codepoint <= 0x200A);
 }
 
-static RenFont *font_group_get_glyph(RenFont **fonts, unsigned int codepoint, int subpixel_idx, SDL_Surface **surface, GlyphMetric **metric) {
-  if (subpixel_idx < 0) subpixel_idx += SUBPIXEL_BITMAPS_CACHED;
+static RenFont *font_group_resolve_glyph(RenFont **fonts, unsigned int codepoint, int *subpixel_idx, unsigned int *glyph_id, GlyphMetric **metric) {
   RenFont *font = NULL;
-  unsigned int glyph_id = 0;
+  *glyph_id = 0;
   for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; i++) {
-    font = fonts[i]; glyph_id = font_get_glyph_id(fonts[i], codepoint);
+    font = fonts[i]; *glyph_id = font_get_glyph_id(fonts[i], codepoint);
     // use the first font that has representation for the glyph ID, but for whitespaces always use the first font
-    if (glyph_id || is_whitespace(codepoint)) break;
+    if (*glyph_id || is_whitespace(codepoint)) break;
   }
   // load the glyph if it is not loaded
-  subpixel_idx = FONT_IS_SUBPIXEL(font) ? subpixel_idx : 0;
-  GlyphMetric *m = font_load_glyph_metric(font, glyph_id, subpixel_idx);
+  *subpixel_idx = FONT_IS_SUBPIXEL(font) ? *subpixel_idx : 0;
+  GlyphMetric *m = font_load_glyph_metric(font, *glyph_id, *subpixel_idx);
   // try the box drawing character (0x25A1) if the requested codepoint is not a whitespace, and we cannot load the .notdef glyph
   if ((!m || !m->flags) && codepoint != 0x25A1 && !is_whitespace(codepoint))
-    return font_group_get_glyph(fonts, 0x25A1, subpixel_idx, surface, metric);
-  if (metric && m) *metric = m;
-  if (surface && m) *surface = font_load_glyph_bitmap(font, glyph_id, subpixel_idx);
+    return font_group_resolve_glyph(fonts, 0x25A1, subpixel_idx, glyph_id, metric);
+  *metric = m;
   return font;
 }
 
-static void font_clear_glyph_cache(RenFont* font) {
+// the resolved glyphs of a font group, emptied if a font changed since they were resolved.
+// Called by the rencache workers for groups prewarmed in the same frame, nothing changes then
+static GroupGlyphs *font_group_get_glyphs(RenFont **fonts) {
+  int count = 0;
+  while (count < FONT_FALLBACK_MAX && fonts[count]) count++;
+  GroupGlyphs *group = fonts[0]->groups;
+  while (group && (memcmp(group->fonts, fonts, sizeof(RenFont *) * count) != 0
+                   || (count < FONT_FALLBACK_MAX && group->fonts[count])))
+    group = group->next;
+  if (!group) {
+    group = check_alloc(SDL_calloc(1, sizeof(GroupGlyphs)));
+    memcpy(group->fonts, fonts, sizeof(RenFont *) * count);
+    group->generation = run_width_generation;
+    group->next = fonts[0]->groups;
+    fonts[0]->groups = group;
+  } else if (group->generation != run_width_generation) {
+    group->generation = run_width_generation;
+    for (int i = 0; i < GROUP_GLYPH_ROW; i++) {
+      SDL_free(group->rows[i]);
+      group->rows[i] = NULL;
+    }
+  }
+  return group;
+}
+
+static void font_free_group_glyphs(RenFont *font) {
+  while (font->groups) {
+    GroupGlyphs *group = font->groups;
+    font->groups = group->next;
+    for (int i = 0; i < GROUP_GLYPH_ROW; i++) SDL_free(group->rows[i]);
+    SDL_free(group);
+  }
+}
+
+static RenFont *font_group_get_glyph(RenFont **fonts, GroupGlyphs *group, unsigned int codepoint, int subpixel_idx, SDL_Surface **surface, GlyphMetric **metric) {
+  if (subpixel_idx < 0) subpixel_idx += SUBPIXEL_BITMAPS_CACHED;
+  GroupGlyph uncached, *glyph = &uncached;
+  if (group && codepoint < GROUP_GLYPH_MAX) {
+    GroupGlyph **row = &group->rows[codepoint / GROUP_GLYPH_COL];
+    if (!*row) *row = check_alloc(SDL_calloc(sizeof(GroupGlyph), GROUP_GLYPH_COL * SUBPIXEL_BITMAPS_CACHED));
+    glyph = &(*row)[(codepoint % GROUP_GLYPH_COL) * SUBPIXEL_BITMAPS_CACHED + subpixel_idx];
+  }
+  if (glyph == &uncached || !glyph->font) {
+    int bitmap_idx = subpixel_idx;
+    *glyph = (GroupGlyph) { 0 };
+    glyph->font = font_group_resolve_glyph(fonts, codepoint, &bitmap_idx, &glyph->glyph_id, &glyph->metric);
+    glyph->bitmap_idx = bitmap_idx;
+  }
+  if (!glyph->metric) return glyph->font;
+  if (metric) *metric = glyph->metric;
+  if (surface) {
+    if (glyph->tick != glyph_tick) {
+      *surface = font_load_glyph_bitmap(glyph->font, glyph->glyph_id, glyph->bitmap_idx);
+      // deferred glyphs are looked up again
+      if (glyph->metric->flags & (EGlyphBitmap | EGlyphNoBitmap)) {
+        glyph->surface = *surface;
+        glyph->tick = glyph_tick;
+      }
+    } else {
+      *surface = glyph->surface;
+    }
+  }
+  return glyph->font;
+}
+
+static void font_clear_glyph_cache(GlyphMap *glyphs) {
   for (int glyph_format_idx = 0; glyph_format_idx < EGlyphFormatSize; glyph_format_idx++) {
-    for (int atlas_idx = 0; atlas_idx < font->glyphs.natlas[glyph_format_idx]; atlas_idx++) {
-      GlyphAtlas *atlas = &font->glyphs.atlas[glyph_format_idx][atlas_idx];
+    for (int atlas_idx = 0; atlas_idx < glyphs->natlas[glyph_format_idx]; atlas_idx++) {
+      GlyphAtlas *atlas = &glyphs->atlas[glyph_format_idx][atlas_idx];
       for (int surface_idx = 0; surface_idx < atlas->nsurface; surface_idx++) {
-        SDL_DestroySurface(atlas->surfaces[surface_idx]);
+        SDL_DestroySurface(atlas->surfaces[surface_idx].surface);
       }
       SDL_free(atlas->surfaces);
     }
-    SDL_free(font->glyphs.atlas[glyph_format_idx]);
-    font->glyphs.atlas[glyph_format_idx] = NULL;
-    font->glyphs.natlas[glyph_format_idx] = 0;
+    SDL_free(glyphs->atlas[glyph_format_idx]);
+    glyphs->atlas[glyph_format_idx] = NULL;
+    glyphs->natlas[glyph_format_idx] = 0;
   }
   // clear glyph metric
-  for (int subpixel_idx = 0; subpixel_idx < FONT_BITMAP_COUNT(font); subpixel_idx++) {
+  for (int subpixel_idx = 0; subpixel_idx < SUBPIXEL_BITMAPS_CACHED; subpixel_idx++) {
     for (int glyphmap_row = 0; glyphmap_row < GLYPHMAP_ROW; glyphmap_row++) {
-      SDL_free(font->glyphs.metrics[subpixel_idx][glyphmap_row]);
-      font->glyphs.metrics[subpixel_idx][glyphmap_row] = NULL;
+      SDL_free(glyphs->metrics[subpixel_idx][glyphmap_row]);
+      glyphs->metrics[subpixel_idx][glyphmap_row] = NULL;
     }
   }
-  font->glyphs.bytesize = 0;
+  glyphs->bytesize = 0;
+  glyphs->atlas_bytes = 0;
+  glyphs->nsurface = glyphs->nglyph = 0;
 }
 
-// based on https://github.com/libsdl-org/SDL_ttf/blob/2a094959055fba09f7deed6e1ffeb986188982ae/SDL_ttf.c#L1735
-static unsigned long font_file_read(FT_Stream stream, unsigned long offset, unsigned char *buffer, unsigned long count) {
-  uint64_t amount;
-  SDL_IOStream *file = (SDL_IOStream *) stream->descriptor.pointer;
-  SDL_SeekIO(file, (int) offset, SDL_IO_SEEK_SET);
-  if (count == 0)
-    return 0;
-  amount = SDL_ReadIO(file, buffer, sizeof(char) * count);
-  if (amount <= 0)
-    return 0;
-  return (unsigned long) amount;
+// maps a whole file read-only, the mapping stays valid after the file is closed
+static const uint8_t *font_file_map(const char *path, size_t *size) {
+  void *data = NULL;
+#ifdef _WIN32
+  LPWSTR wpath = utfconv_utf8towc(path);
+  if (!wpath) return NULL;
+  HANDLE file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  SDL_free(wpath);
+  if (file == INVALID_HANDLE_VALUE) return NULL;
+  LARGE_INTEGER file_size;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && (uint64_t) file_size.QuadPart <= SIZE_MAX) {
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping) {
+      data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+      *size = (size_t) file_size.QuadPart;
+    }
+  }
+  CloseHandle(file);
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) data = NULL;
+    *size = info.st_size;
+  }
+  close(fd);
+#endif
+  return data;
 }
 
-static void font_file_close(FT_Stream stream) {
-  if (stream && stream->descriptor.pointer)
-    SDL_CloseIO((SDL_IOStream *) stream->descriptor.pointer);
-  SDL_free(stream);
+static void font_file_unmap(const uint8_t *data, size_t size) {
+#ifdef _WIN32
+  (void) size;
+  UnmapViewOfFile(data);
+#else
+  munmap((void *) data, size);
+#endif
 }
 
-static int font_set_face_metrics(RenFont *font, FT_Face face) {
-  FT_Error err;
+static FontFile *font_file_acquire(const char *path) {
+  for (FontFile *file = font_files; file; file = file->next) {
+    if (strcmp(file->path, path) == 0) {
+      file->refs++;
+      return file;
+    }
+  }
+
+  // the file is mapped once and every size of every font loaded from it reads
+  // from memory, files that can't be mapped are read whole instead
+  size_t size = 0;
+  bool mapped = true;
+  const uint8_t *data = font_file_map(path, &size);
+  if (!data) {
+    mapped = false;
+    if (!(data = SDL_LoadFile(path, &size))) return NULL; // error set by SDL_LoadFile
+  }
+
+  FT_Error err = FT_Err_Ok;
+  FT_Face face = NULL;
+  if ((err = FT_New_Memory_Face(library, data, (FT_Long) size, 0, &face)) != 0) {
+    if (mapped) font_file_unmap(data, size);
+    else SDL_free((void *) data);
+    SDL_SetError("%s", get_ft_error(err));
+    return NULL;
+  }
+  int len = strlen(path);
+  FontFile *file = check_alloc(SDL_calloc(1, sizeof(FontFile) + len + 1));
+  strcpy(file->path, path);
+  file->data = data;
+  file->size = size;
+  file->mapped = mapped;
+  file->face = face;
+  file->refs = 1;
+  file->next = font_files;
+  font_files = file;
+  return file;
+}
+
+static void font_file_release(FontFile *file) {
+  if (--file->refs > 0) return;
+  for (FontFile **f = &font_files; *f; f = &(*f)->next) {
+    if (*f == file) { *f = file->next; break; }
+  }
+  for (int i = 0; i < CHARMAP_ROW; i++) {
+    SDL_free(file->charmap.rows[i]);
+  }
+  // the face reads from the file data until it is done
+  FT_Done_Face(file->face);
+  if (file->mapped) font_file_unmap(file->data, file->size);
+  else SDL_free((void *) file->data);
+  SDL_free(file);
+}
+
+static void font_queue_prewarm(RenFont *font, unsigned int codepoint) {
+  if (prewarm_len == prewarm_capacity && prewarm_head > 0) {
+    memmove(prewarm_queue, prewarm_queue + prewarm_head, sizeof(PrewarmGlyph) * (prewarm_len - prewarm_head));
+    prewarm_len -= prewarm_head;
+    prewarm_head = 0;
+  }
+  if (prewarm_len == prewarm_capacity) {
+    if (prewarm_capacity >= FONT_PREWARM_MAX) return;
+    prewarm_capacity = prewarm_capacity ? prewarm_capacity * 2 : 256;
+    prewarm_queue = check_alloc(SDL_realloc(prewarm_queue, sizeof(PrewarmGlyph) * prewarm_capacity));
+  }
+  prewarm_queue[prewarm_len++] = (PrewarmGlyph) { .font = font, .codepoint = codepoint };
+}
+
+static void font_dequeue_prewarm(RenFont *font) {
+  size_t len = prewarm_head;
+  for (size_t i = prewarm_head; i < prewarm_len; i++) {
+    if (prewarm_queue[i].font != font) prewarm_queue[len++] = prewarm_queue[i];
+  }
+  prewarm_len = len;
+}
+
+// rasterizes queued glyphs for a little while, called once the frame is presented and while idle
+static void font_prewarm_step(void) {
+  bool deferred = glyphs_deferred;
+  raster_ns = 0;
+  while (prewarm_head < prewarm_len && raster_ns < FONT_PREWARM_BUDGET_NS) {
+    PrewarmGlyph glyph = prewarm_queue[prewarm_head++];
+    unsigned int glyph_id = font_get_glyph_id(glyph.font, glyph.codepoint);
+    for (int i = 0; glyph_id && i < FONT_BITMAP_COUNT(glyph.font); i++)
+      font_load_glyph_bitmap(glyph.font, glyph_id, i);
+  }
+  if (prewarm_head == prewarm_len) prewarm_head = prewarm_len = 0;
+  // the prewarm does not take from the budget of the next frame
+  raster_ns = 0;
+  glyphs_deferred = deferred;
+}
+
+static uint64_t font_file_get_hash(FontFile *file) {
+  if (file->hash) return file->hash;
+  const uint8_t *data = file->data;
+  size_t size = file->size;
+  uint64_t h = 0xcbf29ce484222325ULL ^ size, word;
+  size_t i = 0;
+  for (; i + sizeof(word) <= size; i += sizeof(word)) {
+    memcpy(&word, data + i, sizeof(word));
+    h = (h ^ word) * 0x9E3779B185EBCA87ULL;
+    h ^= h >> 29;
+  }
+  for (; i < size; i++)
+    h = (h ^ data[i]) * 0x100000001b3ULL;
+  file->hash = h ? h : 1;
+  return file->hash;
+}
+
+static void glyph_cache_get_path(FontCache *cache, char *path, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (const char *c = cache->file->path; *c; c++)
+    h = (h ^ (unsigned char) *c) * 0x100000001b3ULL;
+  uint32_t size_bits;
+  memcpy(&size_bits, &cache->pixel_size, sizeof(size_bits));
+  h = (h ^ size_bits) * 0x100000001b3ULL;
+  h = (h ^ (cache->antialiasing | cache->hinting << 8 | cache->style << 16)) * 0x100000001b3ULL;
+  snprintf(path, len, "%s/%016llx.glyphs", glyph_cache_dir, (unsigned long long) h);
+}
+
+// packs the glyphs saved by an earlier session into the atlases of a new cache,
+// the file is ignored unless it was written for the same font file and options
+static void font_cache_restore(FontCache *cache) {
+  if (!glyph_cache_dir) return;
+  char path[1024];
+  glyph_cache_get_path(cache, path, sizeof(path));
+  size_t size;
+  uint8_t *data = SDL_LoadFile(path, &size);
+  if (!data) return;
+
+  GlyphCacheHeader header;
+  if (size < sizeof(header)) goto done;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != GLYPH_CACHE_MAGIC || header.version != GLYPH_CACHE_VERSION
+      || header.pixel_size != cache->pixel_size || header.antialiasing != cache->antialiasing
+      || header.hinting != cache->hinting || header.style != cache->style
+      || header.file_hash != font_file_get_hash(cache->file))
+    goto done;
+
+  const uint8_t *p = data + sizeof(header), *end = data + size;
+  long em = cache->size->metrics.max_advance / 64;
+  if (cache->size->metrics.height / 64 > em) em = cache->size->metrics.height / 64;
+  if ((long) cache->pixel_size > em) em = (long) cache->pixel_size;
+  uint32_t max_extent = FONT_GLYPH_MAX_EMS * (uint32_t) em + FONT_WIDTH_OVERFLOW_PX;
+  for (uint32_t i = 0; i < header.count; i++) {
+    GlyphCacheRecord record;
+    if ((size_t) (end - p) < sizeof(record)) break;
+    memcpy(&record, p, sizeof(record));
+    p += sizeof(record);
+    int depth = 0;
+    if (record.glyph_id >= GLYPHMAP_ROW * GLYPHMAP_COL || record.bitmap_idx >= FONT_BITMAP_COUNT(cache)
+        || record.format >= EGlyphFormatSize || glyphformat_to_pixelformat(record.format, &depth) == SDL_PIXELFORMAT_UNKNOWN)
+      break;
+    size_t stride = (size_t) record.width * (depth / 8);
+    size_t bytes = record.flags & EGlyphBitmap ? stride * record.rows : 0;
+    if ((size_t) (end - p) < bytes || ((record.flags & EGlyphBitmap) && (!record.width || !record.rows)))
+      break;
+    // nothing rasterized at this size is more than a few ems wide or tall, the
+    // rows must also fit in a new surface, which isn't checked when allocating
+    if ((record.flags & EGlyphBitmap) && (record.width > max_extent || record.rows > max_extent
+        || record.rows > (uint32_t) GLYPHS_PER_ATLAS * font_glyph_line_height(cache, record.rows)))
+      break;
+
+    // like font_load_glyph_metric, the metrics of every subpixel bitmap are set at once
+    int row = record.glyph_id / GLYPHMAP_COL, col = record.glyph_id - (row * GLYPHMAP_COL);
+    for (int j = 0; j < FONT_BITMAP_COUNT(cache); j++) {
+      if (!cache->glyphs.metrics[j][row]) {
+        cache->glyphs.metrics[j][row] = check_alloc(SDL_calloc(sizeof(GlyphMetric), GLYPHMAP_COL));
+        cache->glyphs.bytesize += sizeof(GlyphMetric) * GLYPHMAP_COL;
+      }
+      cache->glyphs.metrics[j][row][col].flags |= EGlyphXAdvance;
+      cache->glyphs.metrics[j][row][col].xadvance = record.xadvance;
+    }
+    GlyphMetric *metric = &cache->glyphs.metrics[record.bitmap_idx][row][col];
+    if (metric->flags & (EGlyphBitmap | EGlyphNoBitmap)) {
+      p += bytes;
+      continue;
+    }
+    if (!(record.flags & EGlyphBitmap)) {
+      metric->flags |= EGlyphNoBitmap;
+      continue;
+    }
+    metric->x1 = record.width;
+    metric->y1 = record.rows;
+    metric->bitmap_left = record.bitmap_left;
+    metric->bitmap_top = record.bitmap_top;
+    metric->format = record.format;
+    SDL_Surface *surface = font_allocate_glyph_surface(cache, record.format, record.rows, metric);
+    if (metric->y1 > (unsigned int) surface->h || metric->x1 > (unsigned int) surface->w) {
+      break;
+    }
+    for (unsigned int line = 0; line < record.rows; line++)
+      memcpy((uint8_t *) surface->pixels + surface->pitch * (line + metric->y0), p + stride * line, stride);
+    metric->flags |= EGlyphBitmap;
+    p += bytes;
+  }
+
+done:
+  SDL_free(data);
+}
+
+static void glyph_cache_append(uint8_t **buffer, size_t *len, size_t *capacity, const void *data, size_t size) {
+  if (*len + size > *capacity) {
+    while (*len + size > *capacity) *capacity = *capacity ? *capacity * 2 : 64 * 1024;
+    *buffer = check_alloc(SDL_realloc(*buffer, *capacity));
+  }
+  memcpy(*buffer + *len, data, size);
+  *len += size;
+}
+
+static bool font_cache_save(FontCache *cache) {
+  GlyphCacheHeader header = {
+    .magic = GLYPH_CACHE_MAGIC, .version = GLYPH_CACHE_VERSION, .file_hash = font_file_get_hash(cache->file),
+    .pixel_size = cache->pixel_size, .antialiasing = cache->antialiasing,
+    .hinting = cache->hinting, .style = cache->style, .count = 0,
+  };
+  uint8_t *buffer = NULL;
+  size_t len = 0, capacity = 0;
+  glyph_cache_append(&buffer, &len, &capacity, &header, sizeof(header));
+  for (int bitmap_idx = 0; bitmap_idx < FONT_BITMAP_COUNT(cache); bitmap_idx++) {
+    for (int row = 0; row < GLYPHMAP_ROW; row++) {
+      GlyphMetric *metrics = cache->glyphs.metrics[bitmap_idx][row];
+      for (unsigned int col = 0; metrics && col < GLYPHMAP_COL; col++) {
+        GlyphMetric *metric = &metrics[col];
+        if (!(metric->flags & (EGlyphBitmap | EGlyphNoBitmap))) continue;
+        GlyphCacheRecord record = {
+          .glyph_id = row * GLYPHMAP_COL + col, .bitmap_idx = bitmap_idx,
+          .flags = metric->flags & (EGlyphBitmap | EGlyphNoBitmap), .xadvance = metric->xadvance,
+        };
+        if (!(metric->flags & EGlyphBitmap)) {
+          glyph_cache_append(&buffer, &len, &capacity, &record, sizeof(record));
+          header.count++;
+          continue;
+        }
+        int depth = 0;
+        glyphformat_to_pixelformat(metric->format, &depth);
+        SDL_Surface *surface = cache->glyphs.atlas[metric->format][metric->atlas_idx].surfaces[metric->surface_idx].surface;
+        record.format = metric->format;
+        record.bitmap_left = metric->bitmap_left;
+        record.bitmap_top = metric->bitmap_top;
+        record.width = metric->x1;
+        record.rows = metric->y1 - metric->y0;
+        glyph_cache_append(&buffer, &len, &capacity, &record, sizeof(record));
+        for (unsigned int line = metric->y0; line < metric->y1; line++)
+          glyph_cache_append(&buffer, &len, &capacity, (uint8_t *) surface->pixels + surface->pitch * line, (size_t) record.width * (depth / 8));
+        header.count++;
+      }
+    }
+  }
+  memcpy(buffer, &header, sizeof(header));
+
+  // written next to the cache and moved over it, so that a crash never leaves a truncated cache behind
+  char path[1024], temp_path[1040];
+  glyph_cache_get_path(cache, path, sizeof(path));
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  bool saved = SDL_SaveFile(temp_path, buffer, len) && SDL_RenamePath(temp_path, path);
+  SDL_free(buffer);
+  return saved;
+}
+
+static float font_get_pixel_size(RenFont *font) {
   float pixel_size = font->size;
   #ifdef LITE_USE_SDL_RENDERER
   pixel_size *= font->scale;
   #endif
-  if ((err = FT_Set_Pixel_Sizes(face, 0, (int) pixel_size)) != 0)
-    return err;
+  return pixel_size;
+}
+
+static FontCache *font_cache_acquire(RenFont *font) {
+  float pixel_size = font_get_pixel_size(font);
+  for (FontCache *cache = font_caches; cache; cache = cache->next) {
+    if (cache->pixel_size == pixel_size && cache->antialiasing == font->antialiasing
+        && cache->hinting == font->hinting && cache->style == font->style
+        && strcmp(cache->file->path, font->path) == 0) {
+      cache->refs++;
+      return cache;
+    }
+  }
+
+  FontFile *file = font_file_acquire(font->path);
+  if (!file) return NULL;
+  FT_Error err;
+  FT_Size size = NULL;
+  if ((err = FT_New_Size(file->face, &size)) != 0
+      || (err = FT_Activate_Size(size)) != 0
+      || (err = FT_Set_Pixel_Sizes(file->face, 0, (int) pixel_size)) != 0) {
+    SDL_SetError("%s", get_ft_error(err));
+    if (size) FT_Done_Size(size);
+    file->active = NULL;
+    font_file_release(file);
+    return NULL;
+  }
+  file->active = size;
+
+  FontCache *cache = check_alloc(SDL_calloc(1, sizeof(FontCache)));
+  cache->file = file;
+  cache->size = size;
+  cache->pixel_size = pixel_size;
+  cache->antialiasing = font->antialiasing;
+  cache->hinting = font->hinting;
+  cache->style = font->style;
+  cache->refs = 1;
+  cache->next = font_caches;
+  font_caches = cache;
+  font_cache_restore(cache);
+
+  // printable ASCII and Latin-1 are drawn by nearly everything
+  for (unsigned int codepoint = 0x21; codepoint <= 0xFF; codepoint++) {
+    if (codepoint < 0x7F || codepoint > 0xA0) font_queue_prewarm(font, codepoint);
+  }
+  return cache;
+}
 
-  font->face = face;
+static void font_cache_release(FontCache *cache) {
+  if (--cache->refs > 0) return;
+  for (FontCache **c = &font_caches; *c; c = &(*c)->next) {
+    if (*c == cache) { *c = cache->next; break; }
+  }
+  font_clear_glyph_cache(&cache->glyphs);
+  if (cache->file->active == cache->size) cache->file->active = NULL;
+  FT_Done_Size(cache->size);
+  font_file_release(cache->file);
+  SDL_free(cache);
+}
+
+static int font_set_face_metrics(RenFont *font) {
+  FT_Error err;
+  FT_Face face = font_get_face(font);
   if(FT_IS_SCALABLE(face)) {
     font->height = (short)((face->height / (float)face->units_per_EM) * font->size);
     font->baseline = (short)((face->ascender / (float)face->units_per_EM) * font->size);
     font->underline_thickness = (unsigned short)((face->underline_thickness / (float)face->units_per_EM) * font->size);
   } else {
-    font->height = (short) font->face->size->metrics.height / 64.0f;
-    font->baseline = (short) font->face->size->metrics.ascender / 64.0f;
+    font->height = (short) face->size->metrics.height / 64.0f;
+    font->baseline = (short) face->size->metrics.ascender / 64.0f;
   }
   if(!font->underline_thickness)
     font->underline_thickness = ceil((double) font->height / 14.0);
@@ -460,14 +1132,8 @@ static int font_set_face_metrics(RenFont *font, FT_Face face) {
 
 RenFont* ren_font_load(const char* path, float size, ERenFontAntialiasing antialiasing, ERenFontHinting hinting, unsigned char style) {
   FT_Error err = FT_Err_Ok;
-  SDL_IOStream *file = NULL; RenFont *font = NULL;
-  FT_Face face = NULL; FT_Stream stream = NULL;
-
-  file = SDL_IOFromFile(path, "rb");
-  if (!file) return NULL; // error set by SDL_IOFromFile
-  
   int len = strlen(path);
-  font = check_alloc(SDL_calloc(1, sizeof(RenFont) + len + 1));
+  RenFont *font = check_alloc(SDL_calloc(1, sizeof(RenFont) + len + 1));
   strcpy(font->path, path);
   font->size = size;
   font->antialiasing = antialiasing;
@@ -478,27 +1144,19 @@ RenFont* ren_font_load(const char* path, float size, ERenFontAntialiasing antial
   font->scale = 1;
 #endif
 
-  stream = check_alloc(SDL_calloc(1, sizeof(FT_StreamRec)));
-  if (!stream) goto stream_failure;
-  stream->read = &font_file_read;
-  stream->close = &font_file_close;
-  stream->descriptor.pointer = file;
-  stream->pos = 0;
-  stream->size = (unsigned long) SDL_GetIOSize(file);
-
-  if ((err = FT_Open_Face(library, &(FT_Open_Args) { .flags = FT_OPEN_STREAM, .stream = stream }, 0, &face)) != 0)
-    goto failure;
-  if ((err = font_set_face_metrics(font, face)) != 0)
-    goto failure;
+  // the face and the glyphs are shared with the other fonts of the same file, size and options
+  if (!(font->cache = font_cache_acquire(font))) {
+    SDL_free(font);
+    return NULL; // error set by font_cache_acquire
+  }
+  if ((err = font_set_face_metrics(font)) != 0) {
+    SDL_SetError("%s", get_ft_error(err));
+    font_dequeue_prewarm(font);
+    font_cache_release(font->cache);
+    SDL_free(font);
+    return NULL;
+  }
   return font;
-
-stream_failure:
-  if (file) SDL_CloseIO(file);
-failure:
-  if (err != FT_Err_Ok) SDL_SetError("%s", get_ft_error(err));
-  if (face) FT_Done_Face(face);
-  if (font) SDL_free(font);
-  return NULL;
 }
 
 RenFont* ren_font_copy(RenFont* font, float size, ERenFontAntialiasing antialiasing, ERenFontHinting hinting, int style) {
@@ -514,15 +1172,68 @@ const char* ren_font_get_path(RenFont *font) {
 }
 
 void ren_font_free(RenFont* font) {
-  font_clear_glyph_cache(font);
-  // free codepoint cache as well
-  for (int i = 0; i < CHARMAP_ROW; i++) {
-    SDL_free(font->charmap.rows[i]);
-  }
-  FT_Done_Face(font->face);
+  run_width_generation++;
+  font_dequeue_prewarm(font);
+  font_free_group_glyphs(font);
+  font_cache_release(font->cache);
   SDL_free(font);
 }
 
+unsigned int ren_font_get_generation(void) {
+  return run_width_generation;
+}
+
+void ren_font_group_get_cache_stats(RenFont **fonts, RenFontCacheStats *stats) {
+  *stats = (RenFontCacheStats) { 0 };
+  for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; ++i) {
+    // fonts of a group may share their glyphs
+    bool counted = false;
+    for (int j = 0; j < i && !counted; ++j) counted = fonts[j]->cache == fonts[i]->cache;
+    if (counted) continue;
+    GlyphMap *glyphs = &fonts[i]->cache->glyphs;
+    stats->bytes += glyphs->bytesize + glyphs->atlas_bytes;
+    stats->atlas_bytes += glyphs->atlas_bytes;
+    stats->budget += FONT_ATLAS_BUDGET;
+    stats->surfaces += glyphs->nsurface;
+    stats->glyphs += glyphs->nglyph;
+    stats->loads += glyphs->loads;
+    stats->evictions += glyphs->evictions;
+  }
+}
+
+void ren_font_set_glyph_cache_dir(const char *dir) {
+  SDL_free(glyph_cache_dir);
+  glyph_cache_dir = dir ? check_alloc(SDL_strdup(dir)) : NULL;
+}
+
+bool ren_font_save_glyph_caches(void) {
+  if (!glyph_cache_dir || !SDL_CreateDirectory(glyph_cache_dir)) return false;
+  bool saved = true;
+  for (FontCache *cache = font_caches; cache; cache = cache->next) {
+    if (cache->glyphs.nglyph > 0) saved = font_cache_save(cache) && saved;
+  }
+  return saved;
+}
+
+bool ren_font_prewarm_glyphs(void) {
+  font_prewarm_step();
+  return prewarm_head < prewarm_len;
+}
+
+unsigned int ren_font_get_glyph_deferrals(void) {
+  return glyph_deferrals;
+}
+
+void ren_font_lock_glyphs(bool locked) {
+  glyphs_locked = locked;
+}
+
+bool ren_font_glyphs_deferred(void) {
+  bool deferred = glyphs_deferred;
+  glyphs_deferred = false;
+  return deferred;
+}
+
 void ren_font_group_set_tab_size(RenFont **fonts, int n) {
   for (int j = 0; j < FONT_FALLBACK_MAX && fonts[j]; ++j) {
     fonts[j]->tab_size = n;
@@ -538,14 +1249,20 @@ float ren_font_group_get_size(RenFont **fonts) {
 }
 
 void ren_font_group_set_size(RenFont **fonts, float size, int surface_scale) {
+  run_width_generation++;
   for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; ++i) {
-    font_clear_glyph_cache(fonts[i]);
+    FontCache *cache = fonts[i]->cache;
     fonts[i]->size = size;
     fonts[i]->tab_size = 2;
     #ifdef LITE_USE_SDL_RENDERER
     fonts[i]->scale = surface_scale;
     #endif
-    font_set_face_metrics(fonts[i], fonts[i]->face);
+    // move to the glyphs of the new size, the old ones stay around while other fonts use them
+    if ((fonts[i]->cache = font_cache_acquire(fonts[i])))
+      font_cache_release(cache);
+    else
+      fonts[i]->cache = cache;
+    font_set_face_metrics(fonts[i]);
   }
 }
 
@@ -554,14 +1271,14 @@ int ren_font_group_get_height(RenFont **fonts) {
 }
 
 // some fonts provide xadvance for whitespaces (e.g. Unifont), which we need to ignore
-float font_get_xadvance(RenFont *font, unsigned int codepoint, GlyphMetric *metric, double curr_x, RenTab tab) {
+float font_get_xadvance(RenFont *font, unsigned int codepoint, GlyphMetric *metric, double curr_x, RenTab tab, int tab_stop) {
   if (!is_whitespace(codepoint) && metric && metric->xadvance) {
     return metric->xadvance;
   }
   if (codepoint != '\t') {
     return font->space_advance;
   }
-  float tab_size = font->space_advance * font->tab_size;
+  float tab_size = font->space_advance * tab_stop;
   if (isnan(tab.offset)) {
     return tab_size;
   }
@@ -574,29 +1291,128 @@ float font_get_xadvance(RenFont *font, unsigned int codepoint, GlyphMetric *metr
   return adv;
 }
 
+static uint64_t run_width_key(RenFont **fonts, const char *text, size_t len, RenTab tab) {
+  uint64_t h = 14695981039346656037ULL;
+  bool has_tab = false;
+  for (size_t i = 0; i < len; i++) {
+    has_tab |= text[i] == '\t';
+    h = (h ^ (unsigned char) text[i]) * 1099511628211ULL;
+  }
+  for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; ++i)
+    h = (h ^ (uintptr_t) fonts[i]) * 1099511628211ULL;
+  h = (h ^ fonts[0]->tab_size) * 1099511628211ULL;
+  // the tab offset only matters if the run contains tabs
+  if (has_tab) {
+    uint64_t offset_bits;
+    memcpy(&offset_bits, &tab.offset, sizeof(offset_bits));
+    h = (h ^ offset_bits) * 1099511628211ULL;
+  }
+  return h;
+}
+
 double ren_font_group_get_width(RenFont **fonts, const char *text, size_t len, RenTab tab, int *x_offset) {
+  uint64_t key = run_width_key(fonts, text, len, tab);
+  RunWidth *entry = &run_width_cache[(key ^ (key >> 32)) & (RUN_WIDTH_CACHE_SIZE - 1)];
+  if (entry->generation == run_width_generation && entry->key == key
+      && entry->font == fonts[0] && entry->len == len) {
+    if (x_offset) *x_offset = entry->x_offset;
+    return entry->width;
+  }
+
   double width = 0;
   const char* end = text + len;
 
-  bool set_x_offset = x_offset == NULL;
+  int first_x_offset = 0;
+  bool set_x_offset = false;
+  GroupGlyphs *group = font_group_get_glyphs(fonts);
   while (text < end) {
     unsigned int codepoint;
     text = utf8_to_codepoint(text, end, &codepoint);
     GlyphMetric *metric = NULL;
-    font_group_get_glyph(fonts, codepoint, 0, NULL, &metric);
-    width += font_get_xadvance(fonts[0], codepoint, metric, width, tab);
+    font_group_get_glyph(fonts, group, codepoint, 0, NULL, &metric);
+    width += font_get_xadvance(fonts[0], codepoint, metric, width, tab, fonts[0]->tab_size);
     if (!set_x_offset && metric) {
       set_x_offset = true;
-      *x_offset = metric->bitmap_left; // TODO: should this be scaled by the surface scale?
+      first_x_offset = metric->bitmap_left; // TODO: should this be scaled by the surface scale?
     }
   }
-  if (!set_x_offset)
-    *x_offset = 0;
 #ifdef LITE_USE_SDL_RENDERER
-  return width / fonts[0]->scale;
-#else
+  width /= fonts[0]->scale;
+#endif
+
+  entry->key = key;
+  entry->font = fonts[0];
+  entry->len = len;
+  entry->generation = run_width_generation;
+  entry->width = width;
+  entry->x_offset = first_x_offset;
+
+  if (x_offset) *x_offset = first_x_offset;
   return width;
+}
+
+// fills the advance of each codepoint at the index of its first byte, 0 for the other bytes;
+// unlike ren_font_group_get_width the run is not kept in the run width cache
+double ren_font_group_get_advances(RenFont **fonts, const char *text, size_t len, RenTab tab, double *advances) {
+  double width = 0;
+  const char *start = text, *end = text + len;
+  GroupGlyphs *group = font_group_get_glyphs(fonts);
+  while (text < end) {
+    unsigned int codepoint;
+    const char *next = utf8_to_codepoint(text, end, &codepoint);
+    GlyphMetric *metric = NULL;
+    font_group_get_glyph(fonts, group, codepoint, 0, NULL, &metric);
+    double advance = font_get_xadvance(fonts[0], codepoint, metric, width, tab, fonts[0]->tab_size);
+    width += advance;
+#ifdef LITE_USE_SDL_RENDERER
+    advance /= fonts[0]->scale;
 #endif
+    advances[text - start] = advance;
+    for (const char *p = text + 1; p < next && p < end; p++)
+      advances[p - start] = 0;
+    text = next;
+  }
+#ifdef LITE_USE_SDL_RENDERER
+  width /= fonts[0]->scale;
+#endif
+  return width;
+}
+
+void ren_font_group_prewarm(RenFont **fonts, const char *text, size_t len) {
+  const char* end = text + len;
+  GroupGlyphs *group = font_group_get_glyphs(fonts);
+  while (text < end) {
+    unsigned int codepoint;
+    text = utf8_to_codepoint(text, end, &codepoint);
+    SDL_Surface *surface = NULL; GlyphMetric *metric = NULL;
+    // the subpixel bitmap drawn depends on the pen position, load all of them;
+    // the group resolves glyphs by position even for fonts without subpixel bitmaps
+    for (int i = 0; i < SUBPIXEL_BITMAPS_CACHED; i++)
+      font_group_get_glyph(fonts, group, codepoint, i, &surface, &metric);
+  }
+}
+
+void ren_font_group_queue_prewarm(RenFont **fonts, const char *text, size_t len) {
+  // codepoints of the basic multilingual plane are only queued once
+  uint64_t queued[0x10000 / 64] = { 0 };
+  const char* end = text + len;
+  while (text < end) {
+    unsigned int codepoint;
+    text = utf8_to_codepoint(text, end, &codepoint);
+    if (is_whitespace(codepoint)) continue;
+    if (codepoint < 0x10000) {
+      if (queued[codepoint / 64] & (1ull << (codepoint % 64))) continue;
+      queued[codepoint / 64] |= 1ull << (codepoint % 64);
+    }
+    for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; i++) {
+      unsigned int glyph_id = font_get_glyph_id(fonts[i], codepoint);
+      if (!glyph_id) continue;
+      GlyphMetric *row = fonts[i]->cache->glyphs.metrics[0][glyph_id / GLYPHMAP_COL];
+      if (!row || !(row[glyph_id % GLYPHMAP_COL].flags & (EGlyphBitmap | EGlyphNoBitmap)))
+        font_queue_prewarm(fonts[i], codepoint);
+      break;
+    }
+  }
 }
 
 #ifdef RENDERER_DEBUG
@@ -604,19 +1420,158 @@ double ren_font_group_get_width(RenFont **fonts, const char *text, size_t len, R
 void ren_font_dump(RenFont *font) {
   char filename[1024];
   for (int glyph_format_idx = 0; glyph_format_idx < EGlyphFormatSize; glyph_format_idx++) {
-    for (int atlas_idx = 0; atlas_idx < font->glyphs.natlas[glyph_format_idx]; atlas_idx++) {
-      GlyphAtlas *atlas = &font->glyphs.atlas[glyph_format_idx][atlas_idx];
+    for (int atlas_idx = 0; atlas_idx < font->cache->glyphs.natlas[glyph_format_idx]; atlas_idx++) {
+      GlyphAtlas *atlas = &font->cache->glyphs.atlas[glyph_format_idx][atlas_idx];
       for (int surface_idx = 0; surface_idx < atlas->nsurface; surface_idx++) {
-        snprintf(filename, 1024, "%s-%d-%d-%d.bmp", font->face->family_name, glyph_format_idx, atlas_idx, surface_idx);
-        SDL_SaveBMP(atlas->surfaces[surface_idx], filename);
+        if (!atlas->surfaces[surface_idx].surface) continue;
+        snprintf(filename, 1024, "%s-%d-%d-%d.bmp", font->cache->file->face->family_name, glyph_format_idx, atlas_idx, surface_idx);
+        SDL_SaveBMP(atlas->surfaces[surface_idx].surface, filename);
       }
     }
   }
-  fprintf(stderr, "%s: %zu bytes\n", font->face->family_name, font->glyphs.bytesize);
+  fprintf(stderr, "%s: %zu bytes\n", font->cache->file->face->family_name, font->cache->glyphs.bytesize + font->cache->glyphs.atlas_bytes);
+}
+#endif
+
+/******************* Blending **********************/
+// glyph coverage and translucent fills are blended per channel as
+//   a = coverage * color.a / 255
+//   dst = (color * a + dst * (255 - a)) / 255
+// with rounded divisions, so the vector kernels give the same result as the scalar one
+typedef struct {
+  const SDL_PixelFormatDetails *format;
+  RenColor color;
+  uint32_t rgb_mask;
+  // surface is 32bpp with byte aligned r, g and b channels
+  bool packed;
+  // coverage byte spread to the r, g and b bytes, and the color in the layout of the surface
+  uint32_t rgb_ones, packed_color;
+  // alpha channel of packed surfaces with a byte aligned alpha, blended as a white channel by fills
+  uint32_t alpha_mask;
+} PixelBlend;
+
+static inline unsigned int blend_div255(unsigned int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+static inline unsigned int blend_channel(unsigned int dst, unsigned int color, unsigned int coverage, unsigned int alpha) {
+  unsigned int a = blend_div255(coverage * alpha);
+  return blend_div255(color * a + dst * (255 - a));
+}
+
+static inline bool blend_channel_packed(uint32_t mask, Uint8 shift) {
+  return shift % 8 == 0 && mask == (uint32_t)0xff << shift;
+}
+
+static void pixel_blend_init(PixelBlend *blend, const SDL_PixelFormatDetails *format, RenColor color) {
+  blend->format = format;
+  blend->color = color;
+  blend->rgb_mask = format->Rmask | format->Gmask | format->Bmask;
+  blend->packed = format->bytes_per_pixel == 4
+    && blend_channel_packed(format->Rmask, format->Rshift)
+    && blend_channel_packed(format->Gmask, format->Gshift)
+    && blend_channel_packed(format->Bmask, format->Bshift);
+  blend->alpha_mask = 0;
+  if (blend->packed) {
+    blend->rgb_ones = (1u << format->Rshift) | (1u << format->Gshift) | (1u << format->Bshift);
+    blend->packed_color = ((uint32_t)color.r << format->Rshift) | ((uint32_t)color.g << format->Gshift) | ((uint32_t)color.b << format->Bshift);
+    if (format->Amask && blend_channel_packed(format->Amask, format->Ashift))
+      blend->alpha_mask = format->Amask;
+  }
+}
+
+#ifdef RENDERER_SSE2
+static inline __m128i blend_div255_epi16(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// blends 4 pixels, coverage is laid out like the pixels, with 0 in the alpha byte
+static inline __m128i blend_pixels_sse2(__m128i dst, __m128i coverage, __m128i color, __m128i alpha) {
+  const __m128i zero = _mm_setzero_si128(), max = _mm_set1_epi16(255);
+  __m128i a_lo = blend_div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(coverage, zero), alpha));
+  __m128i a_hi = blend_div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(coverage, zero), alpha));
+  __m128i lo = _mm_add_epi16(_mm_mullo_epi16(color, a_lo), _mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), _mm_sub_epi16(max, a_lo)));
+  __m128i hi = _mm_add_epi16(_mm_mullo_epi16(color, a_hi), _mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), _mm_sub_epi16(max, a_hi)));
+  return _mm_packus_epi16(blend_div255_epi16(lo), blend_div255_epi16(hi));
+}
+#endif
+
+#ifdef RENDERER_NEON
+static inline uint16x8_t blend_div255_u16(uint16x8_t x) {
+  x = vaddq_u16(x, vdupq_n_u16(128));
+  return vshrq_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
 }
+
+// blends 2 pixels, coverage is laid out like the pixels, with 0 in the alpha byte
+static inline uint8x8_t blend_pixels_neon(uint8x8_t dst, uint8x8_t coverage, uint8x8_t color, uint8x8_t alpha) {
+  uint8x8_t a = vmovn_u16(blend_div255_u16(vmull_u8(coverage, alpha)));
+  uint16x8_t res = vmlal_u8(vmull_u8(color, a), dst, vsub_u8(vdup_n_u8(255), a));
+  return vmovn_u16(blend_div255_u16(res));
+}
+#endif
+
+static inline uint32_t glyph_coverage(const PixelBlend *blend, const uint8_t *src, bool subpixel) {
+  if (!subpixel)
+    return src[0] * blend->rgb_ones;
+  const SDL_PixelFormatDetails *format = blend->format;
+  return ((uint32_t)src[0] << format->Rshift) | ((uint32_t)src[1] << format->Gshift) | ((uint32_t)src[2] << format->Bshift);
+}
+
+static void blend_glyph_row(const PixelBlend *blend, uint32_t *dst, const uint8_t *src, int count, bool subpixel) {
+  const SDL_PixelFormatDetails *format = blend->format;
+  const RenColor color = blend->color;
+  const int src_stride = subpixel ? 3 : 1;
+  int i = 0;
+
+  if (blend->packed) {
+#if defined(RENDERER_SSE2) || defined(RENDERER_NEON)
+  #ifdef RENDERER_SSE2
+    const __m128i color_vec = _mm_unpacklo_epi8(_mm_set1_epi32(blend->packed_color), _mm_setzero_si128());
+    const __m128i alpha_vec = _mm_set1_epi16(color.a);
+  #else
+    const uint8x8_t color_vec = vreinterpret_u8_u32(vdup_n_u32(blend->packed_color));
+    const uint8x8_t alpha_vec = vdup_n_u8(color.a);
+  #endif
+    for (; i + 4 <= count; i += 4, src += 4 * src_stride) {
+      uint32_t coverage[4];
+      for (int j = 0; j < 4; j++)
+        coverage[j] = glyph_coverage(blend, src + j * src_stride, subpixel);
+      // glyph bitmaps are mostly empty space
+      if (!(coverage[0] | coverage[1] | coverage[2] | coverage[3]))
+        continue;
+  #ifdef RENDERER_SSE2
+      __m128i pixels = _mm_loadu_si128((const __m128i *)(dst + i));
+      __m128i cov = _mm_loadu_si128((const __m128i *)coverage);
+      _mm_storeu_si128((__m128i *)(dst + i), blend_pixels_sse2(pixels, cov, color_vec, alpha_vec));
+  #else
+      uint8x16_t pixels = vld1q_u8((const uint8_t *)(dst + i));
+      uint8x16_t cov = vld1q_u8((const uint8_t *)coverage);
+      uint8x8_t lo = blend_pixels_neon(vget_low_u8(pixels), vget_low_u8(cov), color_vec, alpha_vec);
+      uint8x8_t hi = blend_pixels_neon(vget_high_u8(pixels), vget_high_u8(cov), color_vec, alpha_vec);
+      vst1q_u8((uint8_t *)(dst + i), vcombine_u8(lo, hi));
+  #endif
+    }
 #endif
+  }
 
-double ren_draw_text(RenSurface *rs, RenFont **fonts, const char *text, size_t len, float x, int y, RenColor color, RenTab tab) {
+  for (; i < count; ++i, src += src_stride) {
+    unsigned int src_r = src[0];
+    unsigned int src_g = subpixel ? src[1] : src[0];
+    unsigned int src_b = subpixel ? src[2] : src[0];
+    if (!(src_r | src_g | src_b))
+      continue;
+    uint32_t pixel = dst[i];
+    // the standard way of doing this would be SDL_GetRGBA, but that introduces a performance regression. needs to be investigated
+    unsigned int r = blend_channel((pixel & format->Rmask) >> format->Rshift, color.r, src_r, color.a);
+    unsigned int g = blend_channel((pixel & format->Gmask) >> format->Gshift, color.g, src_g, color.a);
+    unsigned int b = blend_channel((pixel & format->Bmask) >> format->Bshift, color.b, src_b, color.a);
+    dst[i] = (pixel & ~blend->rgb_mask) | r << format->Rshift | g << format->Gshift | b << format->Bshift;
+  }
+}
+
+double ren_draw_text(RenSurface *rs, RenFont **fonts, const char *text, size_t len, float x, int y, RenColor color, RenTab tab, int tab_size) {
   SDL_Surface *surface = rs->surface;
   SDL_Rect clip;
   SDL_GetSurfaceClipRect(surface, &clip);
@@ -628,26 +1583,35 @@ double ren_draw_text(RenSurface *rs, RenFont **fonts, const char *text, size_t l
   const char* end = text + len;
   uint8_t* destination_pixels = surface->pixels;
   int clip_end_x = clip.x + clip.w, clip_end_y = clip.y + clip.h;
+  const SDL_PixelFormatDetails* surface_format = SDL_GetPixelFormatDetails(surface->format);
+  PixelBlend blend;
+  pixel_blend_init(&blend, surface_format, color);
 
   RenFont* last = NULL;
   double last_pen_x = x;
   bool underline = fonts[0]->style & FONT_STYLE_UNDERLINE;
   bool strikethrough = fonts[0]->style & FONT_STYLE_STRIKETHROUGH;
+  GroupGlyphs *group = font_group_get_glyphs(fonts);
 
   while (text < end) {
-    unsigned int codepoint, r, g, b;
+    unsigned int codepoint;
     text = utf8_to_codepoint(text, end,  &codepoint);
     SDL_Surface *font_surface = NULL; GlyphMetric *metric = NULL;
-    RenFont* font = font_group_get_glyph(fonts, codepoint, (int)(fmod(pen_x, 1.0) * SUBPIXEL_BITMAPS_CACHED), &font_surface, &metric);
+    RenFont* font = font_group_get_glyph(fonts, group, codepoint, (int)(fmod(pen_x, 1.0) * SUBPIXEL_BITMAPS_CACHED), &font_surface, &metric);
     if (!metric)
       break;
     int start_x = floor(pen_x) + metric->bitmap_left;
     int end_x = metric->x1 + start_x; // x0 is assumed to be 0
     int glyph_end = metric->x1, glyph_start = 0;
-    if (!font_surface && !is_whitespace(codepoint))
-      ren_draw_rect(rs, (RenRect){ start_x + 1, y, font->space_advance - 1, ren_font_group_get_height(fonts) }, color);
+    if (!font_surface && !is_whitespace(codepoint)) {
+      // glyphs left for a later frame are drawn as a faint box, glyphs without a bitmap as a solid one
+      RenColor box = color;
+      if (!(metric->flags & EGlyphNoBitmap)) box.a /= 4;
+      ren_draw_rect(rs, (RenRect){ start_x + 1, y, font->space_advance - 1, ren_font_group_get_height(fonts) }, box);
+    }
     if (!is_whitespace(codepoint) && font_surface && color.a > 0 && end_x >= clip.x && start_x < clip_end_x) {
       uint8_t* source_pixels = font_surface->pixels;
+      const SDL_PixelFormatDetails* font_surface_format = SDL_GetPixelFormatDetails(font_surface->format);
       for (int line = metric->y0; line < metric->y1; ++line) {
         int target_y = line - metric->y0 + y - metric->bitmap_top + (fonts[0]->baseline * surface_scale);
         if (target_y < clip.y)
@@ -662,42 +1626,13 @@ double ren_draw_text(RenSurface *rs, RenFont **fonts, const char *text, size_t l
           glyph_start += offset;
         }
         
-        const SDL_PixelFormatDetails* surface_format = SDL_GetPixelFormatDetails(surface->format);
-        const SDL_PixelFormatDetails* font_surface_format = SDL_GetPixelFormatDetails(font_surface->format);
-
         uint32_t* destination_pixel = (uint32_t*)&(destination_pixels[surface->pitch * target_y + start_x * surface_format->bytes_per_pixel]);
         uint8_t* source_pixel = &source_pixels[line * font_surface->pitch + glyph_start * font_surface_format->bytes_per_pixel];
-        for (int x = glyph_start; x < glyph_end; ++x) {
-          uint32_t destination_color = *destination_pixel;
-          // the standard way of doing this would be SDL_GetRGBA, but that introduces a performance regression. needs to be investigated
-          SDL_Color dst = {
-            (destination_color & surface_format->Rmask) >> surface_format->Rshift,
-            (destination_color & surface_format->Gmask) >> surface_format->Gshift,
-            (destination_color & surface_format->Bmask) >> surface_format->Bshift,
-            (destination_color & surface_format->Amask) >> surface_format->Ashift};
-          SDL_Color src;
-
-          if (metric->format == EGlyphFormatSubpixel) {
-            src.r = *(source_pixel++);
-            src.g = *(source_pixel++);
-          } else {
-            src.r = *(source_pixel);
-            src.g = *(source_pixel);
-          }
-
-          src.b = *(source_pixel++);
-          src.a = 0xFF;
-
-          r = (color.r * src.r * color.a + dst.r * (65025 - src.r * color.a) + 32767) / 65025;
-          g = (color.g * src.g * color.a + dst.g * (65025 - src.g * color.a) + 32767) / 65025;
-          b = (color.b * src.b * color.a + dst.b * (65025 - src.b * color.a) + 32767) / 65025;
-          // the standard way of doing this would be SDL_GetRGBA, but that introduces a performance regression. needs to be investigated
-          *destination_pixel++ = (unsigned int) dst.a << surface_format->Ashift | r << surface_format->Rshift | g << surface_format->Gshift | b << surface_format->Bshift;
-        }
+        blend_glyph_row(&blend, destination_pixel, source_pixel, glyph_end - glyph_start, metric->format == EGlyphFormatSubpixel);
       }
     }
 
-    float adv = font_get_xadvance(fonts[0], codepoint, metric, pen_x - original_pen_x, tab);
+    float adv = font_get_xadvance(fonts[0], codepoint, metric, pen_x - original_pen_x, tab, tab_size);
 
     if(!last) last = font;
     else if(font != last || text == end) {
@@ -724,6 +1659,52 @@ static inline RenColor blend_pixel(RenColor dst, RenColor src) {
   return dst;
 }
 
+// blends the color over a clipped rectangle of a packed surface
+static void blend_fill_rect(SDL_Surface *surface, const PixelBlend *blend, const SDL_Rect *rect) {
+  const SDL_PixelFormatDetails *format = blend->format;
+  const RenColor color = blend->color;
+  const uint32_t coverage = 0xff * blend->rgb_ones | blend->alpha_mask;
+  const uint32_t packed_color = blend->packed_color | blend->alpha_mask;
+#ifdef RENDERER_SSE2
+  const __m128i coverage_vec = _mm_set1_epi32(coverage);
+  const __m128i color_vec = _mm_unpacklo_epi8(_mm_set1_epi32(packed_color), _mm_setzero_si128());
+  const __m128i alpha_vec = _mm_set1_epi16(color.a);
+#elif defined(RENDERER_NEON)
+  const uint8x8_t coverage_vec = vreinterpret_u8_u32(vdup_n_u32(coverage));
+  const uint8x8_t color_vec = vreinterpret_u8_u32(vdup_n_u32(packed_color));
+  const uint8x8_t alpha_vec = vdup_n_u8(color.a);
+#endif
+  const unsigned int a = blend_div255(0xff * color.a);
+
+  for (int y = rect->y; y < rect->y + rect->h; ++y) {
+    uint32_t *dst = (uint32_t *)((uint8_t *)surface->pixels + y * surface->pitch) + rect->x;
+    int i = 0;
+#ifdef RENDERER_SSE2
+    for (; i + 4 <= rect->w; i += 4) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)(dst + i));
+      _mm_storeu_si128((__m128i *)(dst + i), blend_pixels_sse2(pixels, coverage_vec, color_vec, alpha_vec));
+    }
+#elif defined(RENDERER_NEON)
+    for (; i + 2 <= rect->w; i += 2) {
+      uint8x8_t pixels = vld1_u8((const uint8_t *)(dst + i));
+      vst1_u8((uint8_t *)(dst + i), blend_pixels_neon(pixels, coverage_vec, color_vec, alpha_vec));
+    }
+#endif
+    for (; i < rect->w; ++i) {
+      uint32_t pixel = dst[i];
+      unsigned int r = blend_div255(color.r * a + ((pixel >> format->Rshift) & 0xff) * (255 - a));
+      unsigned int g = blend_div255(color.g * a + ((pixel >> format->Gshift) & 0xff) * (255 - a));
+      unsigned int b = blend_div255(color.b * a + ((pixel >> format->Bshift) & 0xff) * (255 - a));
+      pixel = (pixel & ~blend->rgb_mask) | r << format->Rshift | g << format->Gshift | b << format->Bshift;
+      if (blend->alpha_mask) {
+        unsigned int pixel_a = blend_div255(0xff * a + ((pixel >> format->Ashift) & 0xff) * (255 - a));
+        pixel = (pixel & ~blend->alpha_mask) | pixel_a << format->Ashift;
+      }
+      dst[i] = pixel;
+    }
+  }
+}
+
 void ren_draw_rect(RenSurface *rs, RenRect rect, RenColor color) {
   if (color.a == 0) { return; }
 
@@ -745,11 +1726,59 @@ void ren_draw_rect(RenSurface *rs, RenRect rect, RenColor color) {
     SDL_GetSurfaceClipRect(surface, &clip);
     if (!SDL_GetRectIntersection(&clip, &dest_rect, &dest_rect)) return;
 
+    PixelBlend blend;
+    pixel_blend_init(&blend, SDL_GetPixelFormatDetails(surface->format), color);
+    if (blend.packed) {
+      blend_fill_rect(surface, &blend, &dest_rect);
+      return;
+    }
+
+    SDL_LockMutex(draw_rect_lock);
     uint32_t *pixel = (uint32_t *)draw_rect_surface->pixels;
     *pixel = SDL_MapSurfaceRGBA(draw_rect_surface, color.r, color.g, color.b, color.a);
     SDL_BlitSurfaceScaled(draw_rect_surface, NULL, surface, &dest_rect, SDL_SCALEMODE_LINEAR);
+    SDL_UnlockMutex(draw_rect_lock);
+  }
+}
+
+#ifdef RENDERER_DEBUG
+// times translucent fills with blend_fill_rect against the scaled 1x1 blit they replaced,
+// on a scratch surface in the format of the window
+int ren_rect_benchmark(RenWindow *window_renderer, RenColor color, int iterations, RenRectTiming *timings, int max) {
+  static const int sizes[][2] = { { 16, 16 }, { 120, 20 }, { 256, 256 }, { 1024, 32 }, { 1920, 1080 } };
+  SDL_PixelFormat format = renwin_get_surface(window_renderer).surface->format;
+  const SDL_PixelFormatDetails *details = SDL_GetPixelFormatDetails(format);
+  PixelBlend blend;
+  pixel_blend_init(&blend, details, color);
+  if (!blend.packed || iterations <= 0) return 0;
+
+  int count = 0;
+  double freq = SDL_GetPerformanceFrequency() / 1e6;
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && count < max; i++) {
+    SDL_Surface *surface = SDL_CreateSurface(sizes[i][0], sizes[i][1], format);
+    if (!surface) break;
+    SDL_Rect rect = { 0, 0, surface->w, surface->h };
+    SDL_FillSurfaceRect(surface, &rect, SDL_MapSurfaceRGB(surface, 0x20, 0x40, 0x60));
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int j = 0; j < iterations; j++)
+      blend_fill_rect(surface, &blend, &rect);
+    Uint64 fill_ticks = SDL_GetPerformanceCounter() - start;
+
+    SDL_LockMutex(draw_rect_lock);
+    *(uint32_t *)draw_rect_surface->pixels = SDL_MapSurfaceRGBA(draw_rect_surface, color.r, color.g, color.b, color.a);
+    start = SDL_GetPerformanceCounter();
+    for (int j = 0; j < iterations; j++)
+      SDL_BlitSurfaceScaled(draw_rect_surface, NULL, surface, &rect, SDL_SCALEMODE_LINEAR);
+    Uint64 blit_ticks = SDL_GetPerformanceCounter() - start;
+    SDL_UnlockMutex(draw_rect_lock);
+
+    SDL_DestroySurface(surface);
+    timings[count++] = (RenRectTiming) { rect.w, rect.h, fill_ticks / freq / iterations, blit_ticks / freq / iterations };
   }
+  return count;
 }
+#endif
 
 /*************** Window Management ****************/
 static void ren_add_window(RenWindow *window_renderer) {
@@ -799,6 +1828,10 @@ int ren_init(void) {
   if (!draw_rect_surface)
     return -1; // error set by SDL_CreateRGBSurface
 
+  draw_rect_lock = SDL_CreateMutex();
+  if (!draw_rect_lock)
+    return -1;
+
   if ((err = FT_Init_FreeType(&library)) != 0)
     return SDL_SetError("%s", get_ft_error(err));
 
@@ -807,6 +1840,7 @@ int ren_init(void) {
 
 void ren_free(void) {
   SDL_DestroySurface(draw_rect_surface);
+  SDL_DestroyMutex(draw_rect_lock);
   FT_Done_FreeType(library);
 }
 
@@ -842,6 +1876,8 @@ void ren_resize_window(RenWindow *window_renderer) {
 void ren_update_rects(RenWindow *window_renderer, RenRect *rects, int count) {
   static bool initial_frame = true;
   renwin_update_rects(window_renderer, rects, count);
+  glyph_tick++;
+  font_prewarm_step();
   if (initial_frame) {
     renwin_show_window(window_renderer);
     initial_frame = false;
@@ -21,6 +21,7 @@ typedef struct { uint8_t b, g, r, a; } RenColor;
 typedef struct { int x, y, width, height; } RenRect;
 typedef struct { double offset; } RenTab;
 typedef struct { SDL_Surface *surface; int scale; } RenSurface;
+typedef struct { size_t bytes, atlas_bytes, budget, loads, evictions; unsigned int surfaces, glyphs; } RenFontCacheStats;
 
 struct RenWindow;
 typedef struct RenWindow RenWindow;
@@ -29,6 +30,21 @@ RenFont* ren_font_load(const char *filename, float size, ERenFontAntialiasing an
 RenFont* ren_font_copy(RenFont* font, float size, ERenFontAntialiasing antialiasing, ERenFontHinting hinting, int style);
 const char* ren_font_get_path(RenFont *font);
 void ren_font_free(RenFont *font);
+/* changes whenever a font is freed or resized, anything holding font pointers
+** or measurements from an older generation must be rebuilt */
+unsigned int ren_font_get_generation(void);
+void ren_font_group_get_cache_stats(RenFont **font, RenFontCacheStats *stats);
+/* whether glyphs were drawn as placeholders since the last call, for lack of
+** rasterization time; the frame must be drawn again */
+bool ren_font_glyphs_deferred(void);
+/* counts the glyphs drawn as placeholders, compared around drawing to find what to draw again */
+unsigned int ren_font_get_glyph_deferrals(void);
+/* while locked, glyphs that aren't loaded yet are drawn as placeholders instead of
+** being rasterized, so that several threads can draw text at once */
+void ren_font_lock_glyphs(bool locked);
+/* rasterized glyphs are saved to and restored from files in dir, NULL disables it */
+void ren_font_set_glyph_cache_dir(const char *dir);
+bool ren_font_save_glyph_caches(void);
 int ren_font_group_get_tab_size(RenFont **font);
 int ren_font_group_get_height(RenFont **font);
 float ren_font_group_get_size(RenFont **font);
@@ -38,7 +54,13 @@ void update_font_scale(RenWindow *window_renderer, RenFont **fonts);
 #endif
 void ren_font_group_set_tab_size(RenFont **font, int n);
 double ren_font_group_get_width(RenFont **font, const char *text, size_t len, RenTab tab, int *x_offset);
-double ren_draw_text(RenSurface *rs, RenFont **font, const char *text, size_t len, float x, int y, RenColor color, RenTab tab);
+/* fills `advances` (len entries) with the advance of each codepoint at its first byte, 0 for the others */
+double ren_font_group_get_advances(RenFont **font, const char *text, size_t len, RenTab tab, double *advances);
+void ren_font_group_prewarm(RenFont **font, const char *text, size_t len);
+void ren_font_group_queue_prewarm(RenFont **font, const char *text, size_t len);
+/* rasterizes queued glyphs for a little while, returns whether some are left */
+bool ren_font_prewarm_glyphs(void);
+double ren_draw_text(RenSurface *rs, RenFont **font, const char *text, size_t len, float x, int y, RenColor color, RenTab tab, int tab_size);
 
 void ren_draw_rect(RenSurface *rs, RenRect rect, RenColor color);
 
@@ -57,4 +79,11 @@ RenWindow* ren_find_window_from_id(uint32_t id);
 RenWindow* ren_get_target_window(void);
 void ren_set_target_window(RenWindow *window);
 
+#ifdef RENDERER_DEBUG
+typedef struct { int width, height; double fill_us, blit_us; } RenRectTiming;
+/* times the translucent rectangle fill against the scaled blit it replaced over
+** several sizes, fills at most max timings (microseconds per call) and returns how many */
+int ren_rect_benchmark(RenWindow *window_renderer, RenColor color, int iterations, RenRectTiming *timings, int max);
+#endif
+
 #endif
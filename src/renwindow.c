@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include "renwindow.h"
 #include "rencache.h"
 
@@ -124,22 +125,113 @@ SDL_Renderer* renwin_get_renderer(RenWindow *ren) {
 #endif
 }
 
+#ifdef LITE_USE_SDL_RENDERER
+/* rects are merged as long as the merged rect is at most this many times
+** bigger than what it covers */
+#define UPLOAD_MERGE_RATIO 2
+
+static inline size_t rect_area(const SDL_Rect *r) {
+  return (size_t) r->w * r->h;
+}
+
+static int compare_rect_y(const void *a, const void *b) {
+  return ((const SDL_Rect*) a)->y - ((const SDL_Rect*) b)->y;
+}
+
+static void upload_rect(RenWindow *ren, const SDL_Rect *r, bool lock) {
+  SDL_Surface *surface = ren->rensurface.surface;
+  const int bpp = SDL_BYTESPERPIXEL(surface->format);
+  const uint8_t *pixels = (const uint8_t *) surface->pixels + r->y * surface->pitch + r->x * bpp;
+  void *dst;
+  int pitch;
+  if (lock && SDL_LockTexture(ren->texture, r, &dst, &pitch)) {
+    /* the locked region is write-only, every row is copied */
+    for (int y = 0; y < r->h; y++) {
+      memcpy((uint8_t *) dst + y * pitch, pixels + y * surface->pitch, (size_t) r->w * bpp);
+    }
+    SDL_UnlockTexture(ren->texture);
+  } else {
+    SDL_UpdateTexture(ren->texture, r, pixels, surface->pitch);
+  }
+  ren->upload_stats.bytes += rect_area(r) * bpp;
+  ren->upload_stats.uploads++;
+}
+
+/* uploads the dirty rects in as few copies as possible: a single locked copy
+** of their bounding rect when they cover most of it, otherwise bands of rects
+** sharing rows */
+static void upload_rects(RenWindow *ren, SDL_Rect *rects, int count) {
+  SDL_Rect bounds = rects[0];
+  size_t area = 0;
+  for (int i = 0; i < count; i++) {
+    SDL_GetRectUnion(&bounds, &rects[i], &bounds);
+    area += rect_area(&rects[i]);
+  }
+  if (rect_area(&bounds) <= area * UPLOAD_MERGE_RATIO) {
+    upload_rect(ren, &bounds, true);
+    return;
+  }
+
+  qsort(rects, count, sizeof(SDL_Rect), compare_rect_y);
+  SDL_Rect band = rects[0];
+  size_t band_area = rect_area(&rects[0]);
+  for (int i = 1; i < count; i++) {
+    SDL_Rect merged;
+    SDL_GetRectUnion(&band, &rects[i], &merged);
+    size_t merged_area = band_area + rect_area(&rects[i]);
+    if (rects[i].y <= band.y + band.h && rect_area(&merged) <= merged_area * UPLOAD_MERGE_RATIO) {
+      band = merged;
+      band_area = merged_area;
+    } else {
+      upload_rect(ren, &band, false);
+      band = rects[i];
+      band_area = rect_area(&rects[i]);
+    }
+  }
+  upload_rect(ren, &band, false);
+}
+#endif
+
 void renwin_update_rects(RenWindow *ren, RenRect *rects, int count) {
+  /* nothing changed, keep what is on screen */
+  if (count <= 0) return;
+  RenUploadStats *stats = &ren->upload_stats;
+  stats->bytes = 0;
+  stats->rects = count;
+  stats->uploads = 0;
 #ifdef LITE_USE_SDL_RENDERER
   const int scale = ren->rensurface.scale;
+  SDL_Surface *surface = ren->rensurface.surface;
+  const SDL_Rect surface_rect = {0, 0, surface->w, surface->h};
+  if (count > ren->upload_buf_size) {
+    SDL_Rect *buf = SDL_realloc(ren->upload_buf, count * sizeof(SDL_Rect));
+    if (!buf) return;
+    ren->upload_buf = buf;
+    ren->upload_buf_size = count;
+  }
+  SDL_Rect *sr = ren->upload_buf;
+  int n = 0;
   for (int i = 0; i < count; i++) {
     const RenRect *r = &rects[i];
-    const int x = scale * r->x, y = scale * r->y;
-    const int w = scale * r->width, h = scale * r->height;
-    const SDL_Rect sr = {.x = x, .y = y, .w = w, .h = h};
-    uint8_t *pixels = ((uint8_t *) ren->rensurface.surface->pixels) + y * ren->rensurface.surface->pitch + x * SDL_BYTESPERPIXEL(ren->rensurface.surface->format);
-    SDL_UpdateTexture(ren->texture, &sr, pixels, ren->rensurface.surface->pitch);
+    SDL_Rect scaled = {.x = scale * r->x, .y = scale * r->y, .w = scale * r->width, .h = scale * r->height};
+    if (SDL_GetRectIntersection(&scaled, &surface_rect, &sr[n])) {
+      n++;
+    }
   }
+  if (n == 0) return;
+  upload_rects(ren, sr, n);
   SDL_RenderTexture(ren->renderer, ren->texture, NULL, NULL);
   SDL_RenderPresent(ren->renderer);
 #else
+  SDL_Surface *surface = SDL_GetWindowSurface(ren->window);
+  for (int i = 0; i < count && surface; i++) {
+    stats->bytes += (size_t) rects[i].width * rects[i].height * SDL_BYTESPERPIXEL(surface->format);
+  }
+  stats->uploads = count;
   SDL_UpdateWindowSurfaceRects(ren->window, (SDL_Rect*) rects, count);
 #endif
+  stats->total_bytes += stats->bytes;
+  stats->frames++;
 }
 
 void renwin_free(RenWindow *ren) {
@@ -148,6 +240,7 @@ void renwin_free(RenWindow *ren) {
   SDL_DestroyTexture(ren->texture);
   SDL_DestroyRenderer(ren->renderer);
   SDL_DestroySurface(ren->rensurface.surface);
+  SDL_free(ren->upload_buf);
 #endif
   SDL_DestroyWindow(ren->window);
   ren->window = NULL;
@@ -1,6 +1,16 @@
 #include <SDL3/SDL.h>
 #include "renderer.h"
 
+/* what renwin_update_rects copied to the screen */
+typedef struct {
+  /* last presented frame */
+  size_t bytes;
+  int rects, uploads;
+  /* since the window was created */
+  size_t total_bytes;
+  uint64_t frames;
+} RenUploadStats;
+
 struct RenWindow {
   SDL_Window *window;
   uint8_t *command_buf;
@@ -12,8 +22,12 @@ struct RenWindow {
   SDL_Renderer *renderer;
   SDL_Texture *texture;
   RenSurface rensurface;
+  /* the dirty rects scaled to pixels */
+  SDL_Rect *upload_buf;
+  int upload_buf_size;
 #endif
   void *cache_state;
+  RenUploadStats upload_stats;
 };
 typedef struct RenWindow RenWindow;
 
@@ -0,0 +1,96 @@
+#include "StateTable.hpp"
+
+namespace syntax
+{
+
+    StateTable &StateTable::getInstance()
+    {
+        static StateTable instance;
+        return instance;
+    }
+
+    StateTable::StateTable()
+    {
+        const char initial = 0;
+        intern(&initial, 1);
+    }
+
+    StateHandle StateTable::intern(const char *bytes, size_t length)
+    {
+        std::string key(bytes, length);
+        auto it = handles.find(key);
+        if (it != handles.end())
+        {
+            return it->second;
+        }
+
+        states.push_back(key);
+        StateHandle handle = (StateHandle)states.size();
+        handles.emplace(std::move(key), handle);
+        return handle;
+    }
+
+    StateHandle StateTable::setPatternIdx(StateHandle state, size_t level, uint8_t patternIdx)
+    {
+        const std::string *bytes = getBytes(state);
+        if (!bytes)
+        {
+            return state;
+        }
+        if (level == 0)
+        {
+            level = 1;
+        }
+
+        uint64_t key = ((uint64_t)state << 32) | ((uint64_t)(level & 0xffffff) << 8) | patternIdx;
+        auto it = setCache.find(key);
+        if (it != setCache.end())
+        {
+            return it->second;
+        }
+
+        std::string next = *bytes;
+        if (level > next.size())
+        {
+            next.push_back((char)patternIdx);
+        }
+        else
+        {
+            next[level - 1] = (char)patternIdx;
+        }
+
+        StateHandle result = intern(next.data(), next.size());
+        setCache.emplace(key, result);
+        return result;
+    }
+
+    StateHandle StateTable::truncate(StateHandle state, size_t length)
+    {
+        const std::string *bytes = getBytes(state);
+        if (!bytes || length >= bytes->size())
+        {
+            return state;
+        }
+
+        uint64_t key = ((uint64_t)state << 32) | (uint64_t)length;
+        auto it = truncateCache.find(key);
+        if (it != truncateCache.end())
+        {
+            return it->second;
+        }
+
+        StateHandle result = intern(bytes->data(), length);
+        truncateCache.emplace(key, result);
+        return result;
+    }
+
+    const std::string *StateTable::getBytes(StateHandle state) const
+    {
+        if (state == 0 || state > states.size())
+        {
+            return nullptr;
+        }
+        return &states[state - 1];
+    }
+
+} // namespace syntax
@@ -0,0 +1,81 @@
+#ifndef STATE_TABLE_HPP
+#define STATE_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace syntax
+{
+
+    /**
+     * Handle of an interned tokenizer state. Equal states share a handle,
+     * so states can be compared as integers.
+     */
+    using StateHandle = uint32_t;
+
+    /**
+     * Interns tokenizer states as small integer handles.
+     *
+     * A state is a string of bytes where the count of bytes represents the
+     * depth of the subsyntax stack and each byte is the index of the active
+     * pattern at that depth (see data/core/tokenizer.lua). Transitions are
+     * cached, so pushing or popping a subsyntax does not build any string
+     * once a transition has been seen.
+     */
+    class StateTable
+    {
+    public:
+        static StateTable &getInstance();
+
+        StateTable(const StateTable &) = delete;
+        StateTable &operator=(const StateTable &) = delete;
+
+        /**
+         * Handle of the initial state, a single zero byte.
+         */
+        static constexpr StateHandle INITIAL = 1;
+
+        /**
+         * Intern a raw state string.
+         */
+        StateHandle intern(const char *bytes, size_t length);
+
+        /**
+         * Set the pattern index at the given depth (1-indexed).
+         * A depth past the end of the state appends a new byte.
+         */
+        StateHandle setPatternIdx(StateHandle state, size_t level, uint8_t patternIdx);
+
+        /**
+         * Keep only the first `length` bytes of the state.
+         */
+        StateHandle truncate(StateHandle state, size_t length);
+
+        /**
+         * Get the raw bytes of a state, or nullptr for an invalid handle.
+         */
+        const std::string *getBytes(StateHandle state) const;
+
+        /**
+         * Number of distinct states seen so far.
+         */
+        size_t getCount() const { return states.size(); }
+
+    private:
+        StateTable();
+
+        std::vector<std::string> states;
+        std::unordered_map<std::string, StateHandle> handles;
+
+        // (state, level, pattern index) -> state
+        std::unordered_map<uint64_t, StateHandle> setCache;
+        // (state, length) -> state
+        std::unordered_map<uint64_t, StateHandle> truncateCache;
+    };
+
+} // namespace syntax
+
+#endif // STATE_TABLE_HPP
@@ -0,0 +1,42 @@
+#include "TokenTypes.hpp"
+#include <limits>
+
+namespace syntax
+{
+
+    TokenTypeRegistry &TokenTypeRegistry::getInstance()
+    {
+        static TokenTypeRegistry instance;
+        return instance;
+    }
+
+    TokenTypeId TokenTypeRegistry::intern(const char *name, size_t length)
+    {
+        std::string key(name, length);
+        auto it = ids.find(key);
+        if (it != ids.end())
+        {
+            return it->second;
+        }
+
+        if (names.size() >= std::numeric_limits<TokenTypeId>::max())
+        {
+            return 0;
+        }
+
+        names.push_back(key);
+        TokenTypeId id = (TokenTypeId)names.size();
+        ids.emplace(std::move(key), id);
+        return id;
+    }
+
+    const std::string *TokenTypeRegistry::getName(TokenTypeId id) const
+    {
+        if (id == 0 || id > names.size())
+        {
+            return nullptr;
+        }
+        return &names[id - 1];
+    }
+
+} // namespace syntax
@@ -0,0 +1,57 @@
+#ifndef TOKEN_TYPES_HPP
+#define TOKEN_TYPES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace syntax
+{
+
+    /**
+     * Dense integer identifier of a token type ("normal", "keyword", ...).
+     * Ids start at 1 so they can be used directly as Lua array indices.
+     */
+    using TokenTypeId = uint16_t;
+
+    /**
+     * Interns token type names into dense ids.
+     * The registry only grows; the set of token types used by syntax
+     * definitions is small and stable for the lifetime of the process.
+     */
+    class TokenTypeRegistry
+    {
+    public:
+        static TokenTypeRegistry &getInstance();
+
+        TokenTypeRegistry(const TokenTypeRegistry &) = delete;
+        TokenTypeRegistry &operator=(const TokenTypeRegistry &) = delete;
+
+        /**
+         * Get the id of a type name, registering it on first use.
+         * Returns 0 if the registry is full.
+         */
+        TokenTypeId intern(const char *name, size_t length);
+
+        /**
+         * Get the name of a registered id, or nullptr if unknown.
+         */
+        const std::string *getName(TokenTypeId id) const;
+
+        /**
+         * Number of registered types, which is also the highest valid id.
+         */
+        size_t getCount() const { return names.size(); }
+
+    private:
+        TokenTypeRegistry() = default;
+
+        std::vector<std::string> names;
+        std::unordered_map<std::string, TokenTypeId> ids;
+    };
+
+} // namespace syntax
+
+#endif // TOKEN_TYPES_HPP
@@ -0,0 +1,195 @@
+#include "DocView.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace view
+{
+
+    static void hashFonts(uint64_t &h, RenFont **fonts)
+    {
+        for (int i = 0; i < FONT_FALLBACK_MAX && fonts[i]; i++)
+        {
+            h = (h ^ (uint64_t)(uintptr_t)fonts[i]) * 0x100000001b3ull;
+        }
+        float size = fonts[0] ? ren_font_group_get_size(fonts) : 0.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &size, sizeof(bits));
+        h = (h ^ bits) * 0x100000001b3ull;
+    }
+
+    void DocView::setPalette(std::vector<TokenStyle> &&styles, RenFont **fonts)
+    {
+        palette = std::move(styles);
+        std::memcpy(defaultFonts, fonts, sizeof(defaultFonts));
+
+        uint64_t h = 0xcbf29ce484222325ull;
+        hashFonts(h, defaultFonts);
+        for (TokenStyle &style : palette)
+        {
+            if (style.fonts[0])
+            {
+                hashFonts(h, style.fonts);
+            }
+            h = (h ^ 0xff) * 0x100000001b3ull;
+        }
+        paletteKey = h;
+    }
+
+    void DocView::drawLines(RenWindow *window, buffer::RopeBuffer &buffer,
+                            size_t first, size_t last, float x, float y,
+                            float lineHeight, const TokenSource &tokens)
+    {
+        size_t lineCount = buffer.getLineCount();
+        last = std::min(last, lineCount);
+
+        for (size_t line = first; line <= last; line++, y += lineHeight)
+        {
+            tokenRuns.clear();
+            if (!tokens(line, tokenRuns))
+            {
+                continue;
+            }
+
+            size_t length;
+            const char *text = buffer.getLine(line, &length);
+            // do not render newline, fixes issue #1164
+            if (length > 0 && text[length - 1] == '\n')
+            {
+                length--;
+            }
+
+            textRuns.clear();
+            size_t offset = 0;
+            for (const TokenRun &token : tokenRuns)
+            {
+                if (offset >= length)
+                {
+                    break;
+                }
+                size_t runLength = std::min(token.length, length - offset);
+                TokenStyle *style = token.type < palette.size() ? &palette[token.type] : nullptr;
+
+                RenTextRun run;
+                run.fonts = style && style->fonts[0] ? style->fonts : defaultFonts;
+                run.color = style ? style->color : TokenStyle().color;
+                run.text = text + offset;
+                run.len = runLength;
+                textRuns.push_back(run);
+                offset += runLength;
+            }
+
+            rencache_draw_text_runs(window, textRuns.data(), textRuns.size(), x, (int)y);
+        }
+    }
+
+    uint64_t DocView::getOffsetsKey(int tabSize) const
+    {
+        // the default font size is checked live, so that a zoom invalidates
+        // the tables before the palette is refreshed by the next draw
+        uint64_t h = paletteKey ^ ((uint64_t)tabSize * 0x9e3779b97f4a7c15ull);
+        float size = defaultFonts[0] ? ren_font_group_get_size(const_cast<RenFont **>(defaultFonts)) : 0.0f;
+        uint32_t bits;
+        std::memcpy(&bits, &size, sizeof(bits));
+        return (h ^ bits) * 0x100000001b3ull;
+    }
+
+    void DocView::measureLine(const char *text, size_t length,
+                              const std::vector<TokenRun> &tokens, int tabSize,
+                              LineOffsets &offsets)
+    {
+        offsets.key = getOffsetsKey(tabSize);
+        offsets.length = length;
+        offsets.cols.clear();
+        offsets.xs.clear();
+        offsets.xs.reserve(length + 1);
+
+        bool ascii = true;
+        for (size_t i = 0; i < length && ascii; i++)
+        {
+            ascii = (unsigned char)text[i] < 0x80;
+        }
+
+        double x = 0;
+        size_t offset = 0;
+        auto measure = [&](RenFont **fonts, size_t end)
+        {
+            if (offset >= end)
+            {
+                return;
+            }
+            // the advances of the whole token at once, tabs stop relative to its start
+            ren_font_group_set_tab_size(fonts, tabSize);
+            size_t start = offset;
+            RenTab tab = {x};
+            advances.resize(end - start);
+            ren_font_group_get_advances(fonts, text + start, end - start, tab, advances.data());
+            while (offset < end)
+            {
+                size_t charLength = 1;
+                while (offset + charLength < end && ((unsigned char)text[offset + charLength] & 0xc0) == 0x80)
+                {
+                    charLength++;
+                }
+                offsets.xs.push_back(x);
+                if (!ascii)
+                {
+                    offsets.cols.push_back((uint32_t)offset + 1);
+                }
+                for (size_t i = 0; i < charLength; i++)
+                {
+                    x += advances[offset - start + i];
+                }
+                offset += charLength;
+            }
+        };
+
+        for (const TokenRun &token : tokens)
+        {
+            if (offset >= length)
+            {
+                break;
+            }
+            TokenStyle *style = token.type < palette.size() ? &palette[token.type] : nullptr;
+            measure(style && style->fonts[0] ? style->fonts : defaultFonts,
+                    std::min(length, offset + token.length));
+        }
+        // text not covered by the tokens, if any
+        measure(defaultFonts, length);
+
+        offsets.xs.push_back(x);
+        if (!ascii)
+        {
+            offsets.cols.push_back((uint32_t)length + 1);
+        }
+    }
+
+    double DocView::colToX(const LineOffsets &offsets, size_t col)
+    {
+        size_t count = offsets.xs.size() - 1;
+        size_t idx;
+        if (offsets.cols.empty())
+        {
+            idx = col < 1 ? 0 : std::min(col - 1, count);
+        }
+        else
+        {
+            idx = std::lower_bound(offsets.cols.begin(), offsets.cols.end() - 1, (uint32_t)std::min<size_t>(col, UINT32_MAX)) - offsets.cols.begin();
+        }
+        return offsets.xs[idx];
+    }
+
+    size_t DocView::xToCol(const LineOffsets &offsets, double x)
+    {
+        size_t count = offsets.xs.size() - 1;
+        // first character whose right edge reaches x
+        size_t idx = std::lower_bound(offsets.xs.begin() + 1, offsets.xs.end(), x) - (offsets.xs.begin() + 1);
+        if (idx >= count)
+        {
+            return offsets.length;
+        }
+        double width = offsets.xs[idx + 1] - offsets.xs[idx];
+        size_t col = x <= offsets.xs[idx] + width / 2 ? offsets.getCol(idx) : offsets.getCol(idx + 1);
+        return std::min(col, offsets.length);
+    }
+
+} // namespace view
@@ -0,0 +1,125 @@
+#ifndef DOC_VIEW_HPP
+#define DOC_VIEW_HPP
+
+#include "View.hpp"
+#include "buf/RopeBuffer.hpp"
+#include "syntax/TokenTypes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+extern "C"
+{
+#include "rencache.h"
+}
+
+namespace view
+{
+
+  /**
+   * Color and font group used to draw one token type.
+   * A null fonts[0] means the view's default font.
+   */
+  struct TokenStyle
+  {
+    RenColor color = {255, 255, 255, 255};
+    RenFont *fonts[FONT_FALLBACK_MAX] = {};
+  };
+
+  /**
+   * A span of `length` bytes of a line highlighted as `type`.
+   */
+  struct TokenRun
+  {
+    syntax::TokenTypeId type;
+    size_t length;
+  };
+
+  /**
+   * Prefix sums of the glyph advances of a line, used to convert between
+   * byte columns and x offsets with a binary search.
+   */
+  struct LineOffsets
+  {
+    // palette and tab size the table was measured with
+    uint64_t key = 0;
+    // byte column (1-indexed) of each character, followed by length + 1;
+    // empty when the line is plain ASCII and columns map to characters
+    std::vector<uint32_t> cols;
+    // x offset of each character, followed by the line width
+    std::vector<double> xs;
+    size_t length = 0;
+
+    size_t getCol(size_t idx) const { return cols.empty() ? idx + 1 : cols[idx]; }
+  };
+
+  /**
+   * Native side of the Lua DocView. Draws highlighted lines straight from
+   * the rope buffer and the highlighter tokens, one rencache command per line.
+   */
+  class DocView : public View
+  {
+  public:
+    DocView() = default;
+    ~DocView() override = default;
+
+    std::string toString() const override { return "DocView"; }
+
+    /**
+     * Fills `runs` with the tokens of a line, returns false if the line
+     * has not been tokenized.
+     */
+    using TokenSource = std::function<bool(size_t line, std::vector<TokenRun> &runs)>;
+
+    /**
+     * Set the styles indexed by token type id and the default font group.
+     */
+    void setPalette(std::vector<TokenStyle> &&styles, RenFont **defaultFonts);
+
+    /**
+     * Draw the text of lines [first, last] (1-indexed). `y` is the text
+     * position of the first line; every following line is `lineHeight`
+     * below. The trailing newline of each line is not drawn.
+     */
+    void drawLines(RenWindow *window, buffer::RopeBuffer &buffer, size_t first,
+                   size_t last, float x, float y, float lineHeight,
+                   const TokenSource &tokens);
+
+    /**
+     * Key identifying the fonts and tab size a LineOffsets table is valid for.
+     */
+    uint64_t getOffsetsKey(int tabSize) const;
+
+    /**
+     * Measure every character of a line with the font of its token.
+     */
+    void measureLine(const char *text, size_t length,
+                     const std::vector<TokenRun> &tokens, int tabSize,
+                     LineOffsets &offsets);
+
+    /**
+     * X offset of the first character starting at or after `col`.
+     */
+    static double colToX(const LineOffsets &offsets, size_t col);
+
+    /**
+     * Column of the character boundary closest to `x`.
+     */
+    static size_t xToCol(const LineOffsets &offsets, double x);
+
+  private:
+    std::vector<TokenStyle> palette;
+    RenFont *defaultFonts[FONT_FALLBACK_MAX] = {};
+    // hash of the palette fonts and their sizes
+    uint64_t paletteKey = 0;
+
+    // scratch buffers reused across lines
+    std::vector<TokenRun> tokenRuns;
+    std::vector<RenTextRun> textRuns;
+    std::vector<double> advances;
+  };
+
+} // namespace view
+
+#endif // DOC_VIEW_HPP
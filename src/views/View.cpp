@@ -21,6 +21,11 @@ namespace view
         {
             luaL_unref(L, LUA_REGISTRYINDEX, luaRef);
         }
+        if (L && layerFontsRef != LUA_NOREF)
+        {
+            luaL_unref(L, LUA_REGISTRYINDEX, layerFontsRef);
+        }
+        rencache_layer_free(layer);
     }
 
     float View::getScrollableSize() const
@@ -286,6 +291,62 @@ namespace view
 
     void View::setScrollable(bool value) { scrollable = value; }
 
+    void View::setRetained(bool retained)
+    {
+        if (retained && !layer)
+        {
+            layer = rencache_layer_new();
+        }
+        else if (!retained && layer)
+        {
+            rencache_layer_free(layer);
+            layer = nullptr;
+        }
+    }
+
+    void View::invalidateLayer()
+    {
+        if (layer)
+        {
+            rencache_layer_invalidate(layer);
+        }
+    }
+
+    void View::beginLayer(RenWindow *window)
+    {
+        if (layer)
+        {
+            layerPosition = position;
+            layerSize = size;
+            recordingLayer = true;
+            rencache_begin_layer(window, layer);
+        }
+    }
+
+    bool View::endLayer(RenWindow *window)
+    {
+        if (!recordingLayer)
+        {
+            return false;
+        }
+        recordingLayer = false;
+        if (layer)
+        {
+            rencache_end_layer(window, layer);
+        }
+        return true;
+    }
+
+    bool View::drawLayer(RenWindow *window)
+    {
+        if (!layer || position.x != layerPosition.x || position.y != layerPosition.y ||
+            size.x != layerSize.x || size.y != layerSize.y)
+        {
+            return false;
+        }
+        return rencache_draw_layer(window, layer);
+    }
+
     void View::update()
     {
         float newScale = ConfigManager::instance().scale;
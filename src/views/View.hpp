@@ -13,6 +13,7 @@ extern "C"
 {
 #include "lua_compat.h"
 #include "renderer.h"
+#include "rencache.h"
 }
 
 namespace view
@@ -97,18 +98,54 @@ namespace view
 
     lua_State *L = nullptr;
     int luaRef = LUA_NOREF;
+    // registry reference to the fonts used by the retained layer
+    int layerFontsRef = LUA_NOREF;
 
     bool checkAndResetRedraw() {
         bool ret = needsRedraw;
         needsRedraw = false;
+        if (ret)
+        {
+            invalidateLayer();
+        }
         return ret;
     }
 
+    /**
+     * Opt in or out of a retained layer. The commands drawn by a retained
+     * view are recorded and replayed on the next frames, until the view is
+     * marked dirty or its position, size or clip rect change.
+     */
+    void setRetained(bool retained);
+    bool isRetained() const { return layer != nullptr; }
+
+    /**
+     * Drop the recorded commands, the view is drawn again on the next frame.
+     */
+    void invalidateLayer();
+
+    /**
+     * Record the commands drawn until endLayer(). No-op if not retained,
+     * endLayer() returns false if nothing was being recorded.
+     */
+    void beginLayer(RenWindow *window);
+    bool endLayer(RenWindow *window);
+
+    /**
+     * Replay the recorded commands, returns false if the view must be drawn.
+     */
+    bool drawLayer(RenWindow *window);
+
   protected:
     void setScrollable(bool value);
 
   private:
     bool needsRedraw = false;
+    RenLayer *layer = nullptr;
+    bool recordingLayer = false;
+    // position and size the layer was recorded at
+    Position layerPosition;
+    Size layerSize;
   };
 
 } // namespace view